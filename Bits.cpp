@@ -1,6 +1,8 @@
 #include <sstream>
 #include <string>
 #include <stdexcept>
+#include <algorithm>
+#include <utility>
 #include "Bits.h"
 
 #include <bitset>
@@ -38,35 +40,41 @@ std::string Bits::ToString() const {
     return bits_str.str();
 }
 
-void BitWriter::AppendBits(const Bits &bits) {
-    int num_final_iteration_bits = bits.GetNumBits() % BITS_PER_ELEM;
-    if (num_final_iteration_bits == 0) {
-        num_final_iteration_bits = BITS_PER_ELEM;
+void BitWriter::AppendBits(const uint64_t bits, const int num_bits) {
+    if (num_bits > MAX_BITS_PER_FLUSH) {
+        PutBits(bits & 0xffffffff, 32);
+        FlushBytes();
+        PutBits(bits >> 32, num_bits - 32);
+    } else {
+        PutBits(bits, num_bits);
     }
-    for (int i = 0; i < bits.ByteLength(); i++) {
-        next_bits_ |= bits.bits_[i] << bit_offset_;
-
-        bool leftover_bits_not_full_byte
-            = i == bits.ByteLength() - 1 && num_final_iteration_bits + bit_offset_ < BITS_PER_ELEM;
-        if (leftover_bits_not_full_byte) {
-            break;
-        }
+    FlushBytes();
+}
 
-        buffer << next_bits_;
-        next_bits_ = bits.bits_[i] >> (BITS_PER_ELEM - bit_offset_);
+void BitWriter::AppendBits(const Bits &bits) {
+    for (int i = 0; i < bits.ByteLength(); i++) {
+        PutBits(bits.bits_[i], std::min(BITS_PER_ELEM, bits.GetNumBits() - i * BITS_PER_ELEM));
+        FlushBytes();
     }
-    bit_offset_ += num_final_iteration_bits;
-    bit_offset_ %= BITS_PER_ELEM;
-
-    total_num_bits_ += bits.GetNumBits();
 }
 
 std::string BitWriter::ToBytes() const {
-    std::string bytes = buffer.str();
-    if (bit_offset_ != 0) {
-        bytes.push_back(next_bits_);
+    BitWriter copy(*this);
+    return copy.TakeBytes();
+}
+
+std::string BitWriter::TakeBytes() {
+    FlushBytes();
+    if (bits_in_register_ != 0) {
+        // the leftover bits were already copied into the buffer by FlushBytes()
+        num_bytes_++;
     }
-    return bytes;
+    buffer_.resize(num_bytes_);
+    return std::move(buffer_);
+}
+
+void BitWriter::Grow() {
+    buffer_.resize(std::max(2 * buffer_.size(), num_bytes_ + sizeof(register_)));
 }
 
 std::ostream &operator<<(std::ostream &lhs, const Bits &rhs) {
@@ -6,6 +6,7 @@
 #include <sstream>
 #include <vector>
 #include <cstdint>
+#include <cstring>
 
 namespace huffman {
 
@@ -40,24 +41,109 @@ class Bits {
 // Appends the given Bits' ToString representation to the given ostream.
 std::ostream &operator<<(std::ostream &lhs, const Bits &rhs);
 
+#define MAX_BITS_PER_FLUSH 56  // bits that can be put between flushes: 63 minus 7 left over
+
 // This class represents a buffer for bits to be appended to.
+// Bits are gathered in a 64-bit register, and written to the buffer 8 bytes at a time.
 class BitWriter {
  public:
+   // Creates a BitWriter whose buffer starts with room for expected_num_bytes bytes.
+   explicit BitWriter(size_t expected_num_bytes = 0) : buffer_(expected_num_bytes + 8, '\0') { }
+
    // Returns the total number of bits that have been written to this BitWriter.
-   uint64_t GetTotalNumBits() const { return total_num_bits_; }
+   uint64_t GetTotalNumBits() const { return num_bytes_ * BITS_PER_ELEM + bits_in_register_; }
+
+   // Appends the lowest num_bits bits of bits (first bit lowest) to the register, without
+   // writing to the buffer. At most MAX_BITS_PER_FLUSH bits can be put between FlushBytes() calls.
+   void PutBits(const uint64_t bits, const int num_bits) {
+       register_ |= bits << bits_in_register_;
+       bits_in_register_ += num_bits;
+   }
+   // Moves all the full bytes in the register into the buffer.
+   void FlushBytes() {
+       if (buffer_.size() - num_bytes_ < sizeof(register_)) {
+           Grow();
+       }
+       memcpy(&buffer_[num_bytes_], &register_, sizeof(register_));
+       int num_full_bytes = bits_in_register_ / BITS_PER_ELEM;
+       num_bytes_ += num_full_bytes;
+       register_ >>= num_full_bytes * BITS_PER_ELEM;
+       bits_in_register_ %= BITS_PER_ELEM;
+   }
 
+   // Appends the lowest num_bits bits of bits (first bit lowest) to this BitWriter,
+   // where num_bits is at most 64.
+   void AppendBits(const uint64_t bits, const int num_bits);
    // Appends the given Bits' bits to this BitWriter.
    void AppendBits(const Bits &bits);
    // Returns a string with all the bits (as bits in the string data) appended onto this BitWriter.
    // There will be unused bits in the last byte of the string if the number of bits appended
    // isn't evenly divisible by BITS_PER_LENGTH.
    std::string ToBytes() const;
+   // Same as ToBytes(), but moves the bytes out of this BitWriter instead of copying them.
+   // This BitWriter should not be used afterwards.
+   std::string TakeBytes();
+
+ private:
+   // Enlarges the buffer so that there is room for at least another 8 bytes.
+   void Grow();
+
+   std::string buffer_;
+   size_t num_bytes_ = 0;
+   uint64_t register_ = 0;
+   int bits_in_register_ = 0;
+};
+
+// This class reads bits (in the order that BitWriter appends them) out of a byte buffer,
+// keeping up to 64 of the upcoming bits in a register so several can be looked at at once.
+class BitReader {
+ public:
+    // Creates a BitReader over the given num_bytes bytes; the bytes must outlive this BitReader.
+    BitReader(const char *bytes, size_t num_bytes)
+        : next_(reinterpret_cast<const unsigned char *>(bytes)),
+          end_(reinterpret_cast<const unsigned char *>(bytes) + num_bytes) { }
+
+    // Tops up the register so that it holds at least 56 bits, unless the buffer has run out.
+    // Bits past the end of the buffer read as 0.
+    void Refill() {
+        if (end_ - next_ >= 8) {
+            // the buffer's bytes are in little-endian order, like the rest of the file's fields
+            uint64_t word;
+            memcpy(&word, next_, sizeof(word));
+            buffer_ |= word << bits_in_buffer_;
+            next_ += (63 - bits_in_buffer_) >> 3;
+            bits_in_buffer_ |= 56;
+        } else {
+            while (bits_in_buffer_ <= 56 && next_ != end_) {
+                buffer_ |= static_cast<uint64_t>(*next_++) << bits_in_buffer_;
+                bits_in_buffer_ += BITS_PER_ELEM;
+            }
+        }
+    }
+
+    // Returns the next num_bits bits (the first bit in the lowest position) without consuming them.
+    // num_bits must be less than 64 and no more than what the last Refill() guaranteed.
+    uint64_t Peek(int num_bits) const { return buffer_ & ((uint64_t(1) << num_bits) - 1); }
+    // Consumes the next num_bits bits.
+    void Consume(int num_bits) {
+        buffer_ >>= num_bits;
+        bits_in_buffer_ -= num_bits;
+    }
+    // Consumes and returns the next bit, refilling the register if needed.
+    bool ReadBit() {
+        if (bits_in_buffer_ <= 0) {
+            Refill();
+        }
+        bool bit_is_one = buffer_ & 0x1;
+        Consume(1);
+        return bit_is_one;
+    }
 
  private:
-   uint64_t total_num_bits_ = 0;
-   std::stringstream buffer;
-   unsigned char next_bits_ = 0;
-   int bit_offset_ = 0;
+    const unsigned char *next_;
+    const unsigned char *end_;
+    uint64_t buffer_ = 0;
+    int bits_in_buffer_ = 0;
 };
 
 }  // namespace huffman
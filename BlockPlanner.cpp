@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include "BlockPlanner.h"
+#include "CompressedWriter.h"
+#include "Stats.h"
+
+namespace huffman {
+
+uint64_t CodeLengthsReprSize(const CodeLengths &code_lengths);
+
+bool CanEncode(const CodeLengths &code_lengths, const ByteHistogram &byte_histogram);
+
+std::array<double, NUM_CHARS> EstimatedCharCosts(const ByteHistogram &byte_histogram);
+
+uint64_t BlockCompressedSize(const CodeLengths &code_lengths, const ByteHistogram &byte_histogram,
+    const size_t num_chars, const bool reuses_code_lengths, const uint32_t stream_flags,
+    const uint32_t sync_interval) {
+    uint64_t num_bits = CompressedNumBits(code_lengths, byte_histogram);
+    uint64_t size = BlockHeader::MetadataSize() + CompressedFileRepr::MetadataSize()
+        + num_bits / BITS_PER_ELEM + static_cast<int>(num_bits % BITS_PER_ELEM != 0);
+    if (!reuses_code_lengths) {
+        size += CodeLengthsReprSize(code_lengths);
+    }
+    if (stream_flags & FLAG_INTERLEAVED_STREAMS) {
+        size += (NUM_INTERLEAVED_STREAMS - 1) * sizeof(uint64_t);
+    }
+    if ((stream_flags & FLAG_SYNC_POINTS) && sync_interval != 0) {
+        // a sync point starts every sync_interval bytes, except the first
+        size_t num_points = num_chars == 0 ? 0 : (num_chars - 1) / sync_interval;
+        size += SyncPointsFileRepr::MetadataSize() + num_points * SyncPointsFileRepr::PointSize();
+    }
+    return size;
+}
+
+uint64_t InterleavedPaddingSize(const CodeLengths &code_lengths, std::string_view block_bytes) {
+    // every stream but the last is padded to a byte boundary, so the padded streams take up
+    // whole bytes, and only the last one's bits share a byte with the padding
+    const size_t stream_length = InterleavedStreamLength(block_bytes.size());
+    uint64_t num_bits = 0;
+    uint64_t padded_num_bits = 0;
+    for (int i = 0; i < NUM_INTERLEAVED_STREAMS; i++) {
+        std::string_view stream_bytes = i + 1 == NUM_INTERLEAVED_STREAMS
+            ? block_bytes.substr(std::min(block_bytes.size(), i * stream_length))
+            : block_bytes.substr(std::min(block_bytes.size(), i * stream_length), stream_length);
+        uint64_t stream_bits = CompressedNumBits(code_lengths, GetByteHistogram(stream_bytes));
+        num_bits += stream_bits;
+        padded_num_bits += i + 1 == NUM_INTERLEAVED_STREAMS
+            ? stream_bits : (stream_bits + BITS_PER_ELEM - 1) / BITS_PER_ELEM * BITS_PER_ELEM;
+    }
+    return (padded_num_bits + BITS_PER_ELEM - 1) / BITS_PER_ELEM
+        - (num_bits + BITS_PER_ELEM - 1) / BITS_PER_ELEM;
+}
+
+uint64_t MinBitsBlockSize(const ByteHistogram &byte_histogram) {
+    return BlockHeader::MetadataSize() + CompressedFileRepr::MetadataSize()
+        + static_cast<uint64_t>(std::ceil(EntropyBits(byte_histogram) / BITS_PER_ELEM));
+}
+
+std::vector<BlockPiece> PlanBlockPieces(std::string_view block_bytes,
+    const CodeLengths *previous_code_lengths, const int max_code_length,
+    const uint32_t stream_flags, const uint32_t sync_interval) {
+    PhaseTimer timer(PHASE_TREE);
+    // the pieces can only start at the boundaries between num_segments equal segments;
+    // histogram_sums[i] counts the bytes before boundary i, so any piece's histogram is
+    // the difference of two sums
+    const int num_segments = std::clamp<size_t>(block_bytes.size() / MIN_BLOCK_PIECE_SIZE, 1,
+        MAX_BLOCK_PIECES);
+    std::vector<size_t> boundaries(num_segments + 1);
+    std::vector<ByteHistogram> histogram_sums(num_segments + 1);
+    histogram_sums[0] = { };
+    for (int i = 1; i <= num_segments; i++) {
+        boundaries[i] = block_bytes.size() * i / num_segments;
+        ByteHistogram segment_histogram = GetByteHistogram(
+            block_bytes.substr(boundaries[i - 1], boundaries[i] - boundaries[i - 1]));
+        for (int c = 0; c < NUM_CHARS; c++) {
+            histogram_sums[i][c] = histogram_sums[i - 1][c] + segment_histogram[c];
+        }
+    }
+    auto make_piece = [&](const int first_segment, const int end_segment) {
+        BlockPiece piece;
+        piece.first_char = boundaries[first_segment];
+        piece.num_chars = boundaries[end_segment] - boundaries[first_segment];
+        piece.reuses_code_lengths = false;
+        for (int c = 0; c < NUM_CHARS; c++) {
+            piece.byte_histogram[c]
+                = histogram_sums[end_segment][c] - histogram_sums[first_segment][c];
+        }
+        piece.code_lengths = LimitCodeLengths(HuffmanCodeLengths(piece.byte_histogram),
+            piece.byte_histogram, max_code_length);
+        return piece;
+    };
+
+    // min_sizes[k] is the fewest bytes that the first k segments compress into, when the last
+    // piece starts at boundary piece_starts[k] (and reuses previous_code_lengths, if reuses[k]);
+    // ties are broken towards fewer pieces
+    std::vector<uint64_t> min_sizes(num_segments + 1, std::numeric_limits<uint64_t>::max());
+    std::vector<int> piece_starts(num_segments + 1, 0);
+    std::vector<bool> reuses(num_segments + 1, false);
+    min_sizes[0] = 0;
+    for (int k = 1; k <= num_segments; k++) {
+        for (int i = 0; i < k; i++) {
+            BlockPiece piece = make_piece(i, k);
+            uint64_t size = min_sizes[i] + BlockCompressedSize(piece.code_lengths,
+                piece.byte_histogram, piece.num_chars, false, stream_flags, sync_interval);
+            if (size < min_sizes[k]) {
+                min_sizes[k] = size;
+                piece_starts[k] = i;
+                reuses[k] = false;
+            }
+            if (i == 0 && previous_code_lengths != nullptr
+                && CanEncode(*previous_code_lengths, piece.byte_histogram)) {
+                size = BlockCompressedSize(*previous_code_lengths, piece.byte_histogram,
+                    piece.num_chars, true, stream_flags, sync_interval);
+                if (size <= min_sizes[k]) {
+                    min_sizes[k] = size;
+                    piece_starts[k] = 0;
+                    reuses[k] = true;
+                }
+            }
+        }
+    }
+
+    std::vector<BlockPiece> pieces;
+    for (int k = num_segments; k > 0; k = piece_starts[k]) {
+        pieces.push_back(make_piece(piece_starts[k], k));
+        if (reuses[k]) {
+            pieces.back().reuses_code_lengths = true;
+            pieces.back().code_lengths = *previous_code_lengths;
+        }
+    }
+    std::reverse(pieces.begin(), pieces.end());
+    return pieces;
+}
+
+std::vector<ByteHistogram> GetContextHistograms(std::string_view block_bytes) {
+    PhaseTimer timer(PHASE_HISTOGRAM);
+    std::vector<ByteHistogram> context_histograms(NUM_CHARS, ByteHistogram { });
+    unsigned char previous = 0;
+    for (const unsigned char c : block_bytes) {
+        context_histograms[previous][c]++;
+        previous = c;
+    }
+    return context_histograms;
+}
+
+ContextPlan PlanContextTables(const std::vector<ByteHistogram> &context_histograms,
+    const int max_code_length) {
+    PhaseTimer timer(PHASE_TREE);
+    // the bytes that follow each used context (and their counts), so that estimating a context's
+    // cost only goes through those
+    std::vector<int> contexts;
+    std::vector<std::vector<std::pair<int, uint64_t>>> context_chars(NUM_CHARS);
+    for (int context = 0; context < NUM_CHARS; context++) {
+        for (int c = 0; c < NUM_CHARS; c++) {
+            if (context_histograms[context][c] != 0) {
+                context_chars[context].emplace_back(c, context_histograms[context][c]);
+            }
+        }
+        if (!context_chars[context].empty()) {
+            contexts.push_back(context);
+        }
+    }
+    auto context_cost = [&](const int context, const std::array<double, NUM_CHARS> &char_costs) {
+        double cost = 0;
+        for (const std::pair<int, uint64_t> &char_count : context_chars[context]) {
+            cost += char_count.second * char_costs[char_count.first];
+        }
+        return cost;
+    };
+
+    // the tables start out as the frequencies of seed contexts, picked one at a time: first the
+    // most common context, then the one that would cost the most bits more under the closest
+    // seed's frequencies than under its own
+    std::vector<std::array<double, NUM_CHARS>> own_char_costs(NUM_CHARS);
+    std::vector<double> own_costs(NUM_CHARS);
+    std::vector<double> closest_seed_costs(NUM_CHARS, std::numeric_limits<double>::infinity());
+    int next_seed = -1;
+    uint64_t max_count = 0;
+    for (const int context : contexts) {
+        own_char_costs[context] = EstimatedCharCosts(context_histograms[context]);
+        own_costs[context] = context_cost(context, own_char_costs[context]);
+        uint64_t count = 0;
+        for (const std::pair<int, uint64_t> &char_count : context_chars[context]) {
+            count += char_count.second;
+        }
+        if (count > max_count) {
+            max_count = count;
+            next_seed = context;
+        }
+    }
+    std::vector<int> seeds;
+    while (next_seed != -1 && seeds.size() < MAX_CONTEXT_TABLES) {
+        seeds.push_back(next_seed);
+        double max_extra_cost = 0;
+        next_seed = -1;
+        for (const int context : contexts) {
+            closest_seed_costs[context] = std::min(closest_seed_costs[context],
+                context_cost(context, own_char_costs[seeds.back()]));
+            if (closest_seed_costs[context] - own_costs[context] > max_extra_cost) {
+                max_extra_cost = closest_seed_costs[context] - own_costs[context];
+                next_seed = context;
+            }
+        }
+    }
+
+    // each number of tables is tried, moving every context to the table it costs the fewest bits
+    // under and then updating the tables' frequencies, a few times over; the plan is the one whose
+    // exact size is smallest (more tables are no longer tried once two in a row didn't help)
+    ContextPlan best_plan;
+    best_plan.compressed_size = std::numeric_limits<uint64_t>::max();
+    size_t best_num_tables = 0;
+    for (size_t num_tables = 1; num_tables <= seeds.size() && num_tables <= best_num_tables + 2;
+        num_tables++) {
+        std::vector<std::array<double, NUM_CHARS>> table_char_costs;
+        for (size_t table = 0; table < num_tables; table++) {
+            table_char_costs.push_back(own_char_costs[seeds[table]]);
+        }
+        ContextMap context_tables = { };
+        std::vector<ByteHistogram> table_histograms;
+        for (int round = 0; round < CONTEXT_CLUSTER_ROUNDS; round++) {
+            for (const int context : contexts) {
+                double min_cost = std::numeric_limits<double>::infinity();
+                for (size_t table = 0; table < num_tables; table++) {
+                    double cost = context_cost(context, table_char_costs[table]);
+                    if (cost < min_cost) {
+                        min_cost = cost;
+                        context_tables[context] = table;
+                    }
+                }
+            }
+            table_histograms.assign(num_tables, ByteHistogram { });
+            for (const int context : contexts) {
+                for (const std::pair<int, uint64_t> &char_count : context_chars[context]) {
+                    table_histograms[context_tables[context]][char_count.first]
+                        += char_count.second;
+                }
+            }
+            for (size_t table = 0; table < num_tables; table++) {
+                table_char_costs[table] = EstimatedCharCosts(table_histograms[table]);
+            }
+        }
+
+        // tables that no context ended up using are dropped
+        ContextPlan plan;
+        std::vector<int> new_tables(num_tables, -1);
+        for (const int context : contexts) {
+            int &new_table = new_tables[context_tables[context]];
+            if (new_table == -1) {
+                new_table = plan.byte_histograms.size();
+                plan.byte_histograms.push_back(table_histograms[context_tables[context]]);
+            }
+        }
+        plan.context_tables = { };
+        for (const int context : contexts) {
+            plan.context_tables[context] = new_tables[context_tables[context]];
+        }
+        uint64_t num_bits = 0;
+        plan.compressed_size = BlockHeader::MetadataSize() + ContextMapFileRepr::MetadataSize()
+            + CompressedFileRepr::MetadataSize();
+        for (const ByteHistogram &byte_histogram : plan.byte_histograms) {
+            plan.code_lengths.push_back(LimitCodeLengths(HuffmanCodeLengths(byte_histogram),
+                byte_histogram, max_code_length));
+            num_bits += CompressedNumBits(plan.code_lengths.back(), byte_histogram);
+            plan.compressed_size += CodeLengthsReprSize(plan.code_lengths.back());
+        }
+        plan.compressed_size += num_bits / BITS_PER_ELEM
+            + static_cast<int>(num_bits % BITS_PER_ELEM != 0);
+        if (plan.compressed_size < best_plan.compressed_size) {
+            best_plan = std::move(plan);
+            best_num_tables = num_tables;
+        }
+    }
+    return best_plan;
+}
+
+uint64_t CodeLengthsReprSize(const CodeLengths &code_lengths) {
+    // see CodeLengthsToFileRepr
+    int num_chars = 0;
+    int max_length = 0;
+    for (const uint8_t length : code_lengths) {
+        num_chars += static_cast<int>(length != 0);
+        max_length = std::max<int>(max_length, length);
+    }
+    return CodeLengthsFileRepr::MetadataSize() + (max_length > 0 ? max_length - 1 : 0) + num_chars;
+}
+
+bool CanEncode(const CodeLengths &code_lengths, const ByteHistogram &byte_histogram) {
+    for (int c = 0; c < NUM_CHARS; c++) {
+        if (byte_histogram[c] != 0 && code_lengths[c] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::array<double, NUM_CHARS> EstimatedCharCosts(const ByteHistogram &byte_histogram) {
+    // each byte counts as occurring half a time more than it does, so that bytes that don't occur
+    // cost many bits instead of infinitely many
+    uint64_t num_chars = 0;
+    for (const uint64_t count : byte_histogram) {
+        num_chars += count;
+    }
+    const double total = num_chars + 0.5 * NUM_CHARS;
+    std::array<double, NUM_CHARS> char_costs;
+    for (int c = 0; c < NUM_CHARS; c++) {
+        char_costs[c] = std::log2(total / (byte_histogram[c] + 0.5));
+    }
+    return char_costs;
+}
+
+}  // namespace huffman
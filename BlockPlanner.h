@@ -0,0 +1,79 @@
+#ifndef _BLOCKPLANNER_H_
+#define _BLOCKPLANNER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "CanonicalCode.h"
+#include "CompressedWriter.h"
+#include "UncompressedReader.h"
+
+namespace huffman {
+
+#define MAX_BLOCK_PIECES 8                  // the most blocks that one block's bytes are split into
+#define MIN_BLOCK_PIECE_SIZE (1 << 14)      // the fewest bytes that a split-off block holds
+#define CONTEXT_CLUSTER_ROUNDS 4            // the times that contexts are moved between tables
+
+// This struct represents a run of a block's bytes that is compressed into a block of its own,
+// along with the bit sequence lengths it is compressed with.
+struct BlockPiece {
+    size_t first_char;              // the offset of the piece's first byte in the block's bytes
+    size_t num_chars;               // the number of bytes in the piece
+    bool reuses_code_lengths;       // whether the piece is a BLOCK_REPEAT block, which uses the
+                                    // code lengths of the block before it
+    CodeLengths code_lengths;       // the lengths that the piece's bytes are compressed with
+    ByteHistogram byte_histogram;   // the number of occurrences of each byte in the piece
+};
+
+// This struct represents how a block's bytes are compressed into a BLOCK_CONTEXT block.
+struct ContextPlan {
+    ContextMap context_tables;              // the table that each context uses
+    std::vector<CodeLengths> code_lengths;  // the lengths of each table's bit sequences
+    std::vector<ByteHistogram> byte_histograms;     // the bytes compressed with each table
+    uint64_t compressed_size;               // the number of bytes the block takes up
+};
+
+// Returns the number of bytes that a block (including its BlockHeader) holding num_chars bytes
+// with the given histogram takes up in a file with the given flags and sync interval, when the
+// bytes are compressed with code_lengths. If reuses_code_lengths, the block is a BLOCK_REPEAT
+// block, which doesn't hold code_lengths. Only the padding between interleaved streams (up to
+// NUM_INTERLEAVED_STREAMS - 1 bytes; see InterleavedPaddingSize) isn't counted.
+uint64_t BlockCompressedSize(const CodeLengths &code_lengths, const ByteHistogram &byte_histogram,
+    const size_t num_chars, const bool reuses_code_lengths, const uint32_t stream_flags,
+    const uint32_t sync_interval);
+
+// Returns the number of bytes of padding between the streams that block_bytes are split into
+// when they are compressed with code_lengths into a block with FLAG_INTERLEAVED_STREAMS (see
+// CompressFileBytesInterleaved), which BlockCompressedSize leaves out.
+uint64_t InterleavedPaddingSize(const CodeLengths &code_lengths, std::string_view block_bytes);
+
+// Returns the fewest bytes that a block holding bytes with the given histogram could take up
+// when they are compressed into bit sequences of whole bits: its headers, plus the entropy of
+// its bytes (see EntropyBits).
+uint64_t MinBitsBlockSize(const ByteHistogram &byte_histogram);
+
+// Decides how to compress block_bytes so that the blocks they're compressed into take up the
+// fewest bytes (see BlockCompressedSize). The bytes are split into up to MAX_BLOCK_PIECES pieces
+// wherever their statistics change enough to pay for another block, and each piece gets its own
+// code lengths (limited to max_code_length), except that the first piece can instead reuse
+// previous_code_lengths (the code lengths of the block before block_bytes; nullptr if there is
+// none). Returns the pieces in order.
+std::vector<BlockPiece> PlanBlockPieces(std::string_view block_bytes,
+    const CodeLengths *previous_code_lengths, const int max_code_length,
+    const uint32_t stream_flags, const uint32_t sync_interval);
+
+// Returns the number of occurrences of each byte in block_bytes after each byte (its context),
+// indexed by the context; the first byte's context is 0.
+std::vector<ByteHistogram> GetContextHistograms(std::string_view block_bytes);
+
+// Decides how to compress a block into a BLOCK_CONTEXT block, given its context_histograms (see
+// GetContextHistograms), so that it takes up the fewest bytes. Contexts whose following bytes are
+// alike share a table, of which there are up to MAX_CONTEXT_TABLES, since each table's lengths
+// (limited to max_code_length) are stored in the block.
+ContextPlan PlanContextTables(const std::vector<ByteHistogram> &context_histograms,
+    const int max_code_length);
+
+}  // namespace huffman
+
+#endif  // _BLOCKPLANNER_H_
@@ -0,0 +1,71 @@
+#ifndef _BOUNDEDQUEUE_H_
+#define _BOUNDEDQUEUE_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace huffman {
+
+// This class represents a first-in first-out queue that passes items from one thread to another
+// and holds at most a fixed number of them. Pushing to a full queue waits for an item to be
+// popped, so the pushing thread can only get so far ahead of the popping one.
+template <class T>
+class BoundedQueue {
+ public:
+    // Creates an empty queue that holds at most capacity items (at least 1).
+    explicit BoundedQueue(const size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) { }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    // Adds item to the back of the queue, once the queue isn't full.
+    void Push(T item) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_full_.wait(lock, [this]() { return items_.size() < capacity_; });
+            items_.push_back(std::move(item));
+        }
+        not_empty_.notify_one();
+    }
+
+    // Marks that no more items will be pushed.
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        not_empty_.notify_all();
+    }
+
+    // Moves the item at the front of the queue into item, once the queue isn't empty.
+    // Returns false (leaving item alone) if the queue is empty and closed.
+    bool Pop(T &item) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_empty_.wait(lock, [this]() { return closed_ || !items_.empty(); });
+            if (items_.empty()) {
+                return false;
+            }
+            item = std::move(items_.front());
+            items_.pop_front();
+        }
+        not_full_.notify_one();
+        return true;
+    }
+
+ private:
+    const size_t capacity_;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    bool closed_ = false;
+};
+
+}  // namespace huffman
+
+#endif  // _BOUNDEDQUEUE_H_
@@ -0,0 +1,105 @@
+#include <stdexcept>
+#include "CanonicalCode.h"
+
+namespace huffman {
+
+std::vector<unsigned char> CanonicalOrder(const CodeLengths &code_lengths) {
+    // counting sort by length; chars of the same length stay in increasing order
+    std::array<int, NUM_CHARS + 1> length_starts = { };
+    for (const uint8_t length : code_lengths) {
+        length_starts[length + 1]++;
+    }
+    for (int length = 1; length <= NUM_CHARS; length++) {
+        length_starts[length] += length_starts[length - 1];
+    }
+
+    const int num_unused = length_starts[1];
+    std::vector<unsigned char> order(NUM_CHARS - num_unused);
+    for (int c = 0; c < NUM_CHARS; c++) {
+        if (code_lengths[c] != 0) {
+            order[length_starts[code_lengths[c]] - num_unused] = c;
+            length_starts[code_lengths[c]]++;
+        }
+    }
+    return order;
+}
+
+std::array<uint64_t, NUM_CHARS> CanonicalCodes(const CodeLengths &code_lengths) {
+    std::array<uint64_t, NUM_CHARS> codes = { };
+    std::vector<unsigned char> order = CanonicalOrder(code_lengths);
+    if (order.empty()) {
+        return codes;
+    }
+
+    uint64_t next_code = 0;
+    int current_length = code_lengths[order.front()];
+    for (const unsigned char c : order) {
+        if (code_lengths[c] > CANONICAL_LENGTH_LIMIT) {
+            throw std::invalid_argument(
+                "Canonical codes cannot exceed CANONICAL_LENGTH_LIMIT bits");
+        }
+        next_code <<= code_lengths[c] - current_length;
+        current_length = code_lengths[c];
+
+        // canonical codes are defined first bit highest, but are written first bit lowest
+        uint64_t reversed = 0;
+        for (int i = 0; i < current_length; i++) {
+            reversed |= ((next_code >> i) & 0x1) << (current_length - 1 - i);
+        }
+        codes[c] = reversed;
+        next_code++;
+    }
+    return codes;
+}
+
+EncodeTable CanonicalEncodeTable(const CodeLengths &code_lengths) {
+    std::array<uint64_t, NUM_CHARS> codes = CanonicalCodes(code_lengths);
+    EncodeTable encode_table;
+    for (int c = 0; c < NUM_CHARS; c++) {
+        encode_table[c] = { codes[c], code_lengths[c] };
+    }
+    return encode_table;
+}
+
+bool CodeLengthsAreComplete(const CodeLengths &code_lengths) {
+    std::array<int, NUM_CHARS> length_counts = { };
+    int num_chars = 0;
+    for (const uint8_t length : code_lengths) {
+        if (length != 0) {
+            length_counts[length]++;
+            num_chars++;
+        }
+    }
+    if (num_chars == 1) {
+        return length_counts[1] == 1;
+    }
+
+    // the number of bit sequences of the current length not yet taken by a char (or its prefix)
+    int64_t unused_sequences = 1;
+    for (int length = 1; length < NUM_CHARS; length++) {
+        unused_sequences = 2 * unused_sequences - length_counts[length];
+        if (unused_sequences < 0 || unused_sequences > num_chars) {
+            return false;
+        }
+    }
+    return unused_sequences == 0;
+}
+
+std::unordered_map<unsigned char, std::unique_ptr<Bits>> CanonicalCharToBits(
+    const CodeLengths &code_lengths) {
+    std::array<uint64_t, NUM_CHARS> codes = CanonicalCodes(code_lengths);
+    std::unordered_map<unsigned char, std::unique_ptr<Bits>> char_to_bits;
+    for (int c = 0; c < NUM_CHARS; c++) {
+        if (code_lengths[c] == 0) {
+            continue;
+        }
+        std::vector<bool> bits(code_lengths[c]);
+        for (int i = 0; i < code_lengths[c]; i++) {
+            bits[i] = (codes[c] >> i) & 0x1;
+        }
+        char_to_bits[c] = std::make_unique<Bits>(Bits(c, bits));
+    }
+    return char_to_bits;
+}
+
+}  // namespace huffman
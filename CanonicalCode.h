@@ -0,0 +1,54 @@
+#ifndef _CANONICALCODE_H_
+#define _CANONICALCODE_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "Bits.h"
+
+namespace huffman {
+
+#define NUM_CHARS 256
+#define CANONICAL_LENGTH_LIMIT 64
+
+// The length of the bit sequence of each char, indexed by the char; 0 means the char is unused.
+typedef std::array<uint8_t, NUM_CHARS> CodeLengths;
+
+// This struct represents the bit sequence that a char is compressed into.
+struct EncodeEntry {
+    uint64_t code;  // the bit sequence, first bit lowest
+    int length;     // the number of bits in the bit sequence
+};
+
+// The bit sequence of each char, indexed by the char.
+typedef std::array<EncodeEntry, NUM_CHARS> EncodeTable;
+
+// Returns the used chars of code_lengths, ordered by bit sequence length then by char.
+// This is the order that canonical bit sequences are assigned in.
+std::vector<unsigned char> CanonicalOrder(const CodeLengths &code_lengths);
+
+// Assigns canonical bit sequences to the chars of code_lengths: chars of the same length get
+// consecutive values, and shorter sequences get smaller values than longer ones.
+// Each returned sequence has its first bit in the lowest position, which is the order they are
+// written to the compressed file in. Throws invalid_argument if a length exceeds
+// CANONICAL_LENGTH_LIMIT.
+std::array<uint64_t, NUM_CHARS> CanonicalCodes(const CodeLengths &code_lengths);
+
+// Returns the canonical bit sequences (see CanonicalCodes) of the chars of code_lengths
+// as an EncodeTable.
+EncodeTable CanonicalEncodeTable(const CodeLengths &code_lengths);
+
+// Returns whether code_lengths describes a complete code: one where every sequence of bits starts
+// with exactly one of the chars' bit sequences. A single char of length 1 counts as complete.
+bool CodeLengthsAreComplete(const CodeLengths &code_lengths);
+
+// Creates a mapping of the used chars of code_lengths to Bits objects holding their canonical
+// bit sequences.
+std::unordered_map<unsigned char, std::unique_ptr<Bits>> CanonicalCharToBits(
+    const CodeLengths &code_lengths);
+
+}  // namespace huffman
+
+#endif  // _CANONICALCODE_H_
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include "Checksum.h"
+#include "Stats.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace huffman {
+
+#define CHARS_PER_CHECKSUM_ELEM 8
+#define CRC32C_POLYNOMIAL 0x82f63b78    // the Castagnoli polynomial, lowest bit first
+#define CRC32C_SLICES 8
+
+typedef std::array<std::array<uint32_t, 256>, CRC32C_SLICES> Crc32cTable;
+
+Crc32cTable BuildCrc32cTable();
+
+uint32_t Crc32cSoftware(uint32_t crc, const unsigned char *next, const unsigned char *end);
+
+#if defined(__x86_64__)
+uint32_t Crc32cHardware(uint32_t crc, const unsigned char *next, const unsigned char *end);
+#endif
+
+Checksum::Checksum(const int type) : type_(type) { }
+
+void Checksum::Update(std::string_view data) {
+    PhaseTimer timer(PHASE_CHECKSUM);
+    const unsigned char *next = reinterpret_cast<const unsigned char *>(data.data());
+    const unsigned char *end = next + data.size();
+    if (type_ == CHECKSUM_CRC32C) {
+#if defined(__x86_64__)
+        static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+        if (has_sse42) {
+            crc_ = Crc32cHardware(crc_, next, end);
+            return;
+        }
+#endif
+        crc_ = Crc32cSoftware(crc_, next, end);
+        return;
+    }
+
+    // finish the current group, then hash whole groups without carrying current_ between bytes:
+    // the hash of a group is 31^8 + 31^7 * c0 + ... + 31 * c6 + c7
+    const unsigned char *group_end = next + std::min<size_t>(data.size(),
+        (CHARS_PER_CHECKSUM_ELEM - group_position_) % CHARS_PER_CHECKSUM_ELEM);
+    UpdateSimple(next, group_end);
+    next = group_end;
+    for (; end - next >= CHARS_PER_CHECKSUM_ELEM; next += CHARS_PER_CHECKSUM_ELEM) {
+        aggregate_ ^= 0x94446f01u
+            + 0x67e12cdfu * next[0] + 0x34e63b41u * next[1] + 0x01b4d89fu * next[2]
+            + 0x000e1781u * next[3] + 0x0000745fu * next[4] + 0x000003c1u * next[5]
+            + 0x0000001fu * next[6] + next[7];
+    }
+    UpdateSimple(next, end);
+}
+
+uint32_t Checksum::GetValue() const {
+    if (type_ == CHECKSUM_CRC32C) {
+        return ~crc_;
+    }
+    return aggregate_ ^ current_;
+}
+
+void Checksum::UpdateSimple(const unsigned char *next, const unsigned char *end) {
+    for (; next != end; next++) {
+        current_ = 31 * current_ + *next;
+        if (++group_position_ == CHARS_PER_CHECKSUM_ELEM) {
+            aggregate_ ^= current_;
+            current_ = 1;
+            group_position_ = 0;
+        }
+    }
+}
+
+Crc32cTable BuildCrc32cTable() {
+    // table[0] advances the CRC by one byte; table[k] advances it by one byte followed by k zeros
+    Crc32cTable table;
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        uint32_t crc = byte;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 0x1) ? CRC32C_POLYNOMIAL : 0);
+        }
+        table[0][byte] = crc;
+    }
+    for (int slice = 1; slice < CRC32C_SLICES; slice++) {
+        for (int byte = 0; byte < 256; byte++) {
+            uint32_t previous = table[slice - 1][byte];
+            table[slice][byte] = (previous >> 8) ^ table[0][previous & 0xff];
+        }
+    }
+    return table;
+}
+
+uint32_t Crc32cSoftware(uint32_t crc, const unsigned char *next, const unsigned char *end) {
+    static const Crc32cTable table = BuildCrc32cTable();
+    // eight bytes at a time (slicing-by-8), as their lookups don't depend on each other
+    for (; end - next >= CRC32C_SLICES; next += CRC32C_SLICES) {
+        uint32_t low;
+        memcpy(&low, next, sizeof(low));
+        low ^= crc;
+        crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff]
+            ^ table[5][(low >> 16) & 0xff] ^ table[4][low >> 24]
+            ^ table[3][next[4]] ^ table[2][next[5]] ^ table[1][next[6]] ^ table[0][next[7]];
+    }
+    for (; next != end; next++) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *next) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t Crc32cHardware(uint32_t crc, const unsigned char *next, const unsigned char *end) {
+    uint64_t crc64 = crc;
+    for (; end - next >= 8; next += 8) {
+        uint64_t word;
+        memcpy(&word, next, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = crc64;
+    for (; next != end; next++) {
+        crc = _mm_crc32_u8(crc, *next);
+    }
+    return crc;
+}
+#endif
+
+}  // namespace huffman
@@ -0,0 +1,39 @@
+#ifndef _CHECKSUM_H_
+#define _CHECKSUM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace huffman {
+
+#define CHECKSUM_SIMPLE 0   // the original checksum, kept for files that were written with it
+#define CHECKSUM_CRC32C 1   // CRC-32C (Castagnoli), computed with SSE4.2 where it is available
+
+// This class computes a checksum of bytes that are given to it in pieces, so that the bytes
+// never need to be gathered into one buffer. Giving it the bytes in any number of pieces gives
+// the same checksum as giving it all of them at once.
+class Checksum {
+ public:
+    // Starts a checksum of no bytes, of the given type (CHECKSUM_SIMPLE or CHECKSUM_CRC32C).
+    explicit Checksum(const int type);
+
+    // Adds the given bytes to the end of the bytes that the checksum is of.
+    void Update(std::string_view data);
+    // Returns the checksum of all the bytes given so far.
+    uint32_t GetValue() const;
+
+ private:
+    // Adds bytes to the simple checksum one at a time, as it was originally defined.
+    void UpdateSimple(const unsigned char *next, const unsigned char *end);
+
+    int type_;
+    uint32_t crc_ = 0xffffffff;     // the CRC-32C so far, before its final inversion
+    uint32_t aggregate_ = 0;        // the simple checksum of the groups of bytes so far
+    uint32_t current_ = 1;          // the simple checksum's hash of the current group of bytes
+    size_t group_position_ = 0;     // the number of bytes so far in the current group
+};
+
+}  // namespace huffman
+
+#endif  // _CHECKSUM_H_
@@ -1,7 +1,7 @@
+#include <algorithm>
 #include <cstring>
 #include <stack>
 #include <memory>
-#include <sstream>
 #include "CompressedReader.h"
 #include "CompressedWriter.h"
 
@@ -9,44 +9,100 @@ namespace huffman {
 
 typedef std::unique_ptr<huffman::TreeNode> NodePtr;
 
-bool PartitionHeader(const std::string &file_contents,
-    std::string &partitioned_tree_and_file_data);
+bool PartitionHeader(std::string_view file_contents, const uint32_t expected_magic_number,
+    std::string_view &partitioned_tree_and_file_data);
 
-bool PartitionTree(const std::string &tree_and_data, TreeFileRepr &tree_data,
-    std::string &partitioned_file_data);
+bool PartitionTree(std::string_view tree_and_data, TreeFileRepr &tree_data,
+    std::string_view &partitioned_file_data);
 
-bool ProcessFileReprData(const std::string &file_repr_data, CompressedFileRepr &file_repr);
+bool PartitionCodeLengths(std::string_view code_lengths_and_file_data,
+    CodeLengthsFileRepr &code_lengths_repr, std::string_view &partitioned_file_data);
 
-size_t MinContentSize() {
-    return FileHeader::MetadataSize() + TreeFileRepr::MetadataSize()
+bool ProcessFileReprData(std::string_view file_repr_data, const uint32_t stream_flags,
+    CompressedFileRepr &file_repr);
+
+bool ProcessSyncPointsData(std::string_view sync_points_data,
+    SyncPointsFileRepr &sync_points_repr);
+
+bool ProcessBlockFileReprData(std::string_view file_repr_data, const uint32_t stream_flags,
+    CompressedFileRepr &file_repr, SyncPointsFileRepr &sync_points_repr);
+
+bool ValidateBlockHeader(const StreamHeader &stream_header, const BlockHeader &block_header);
+
+void ParseBlockHeader(const char *number_buffer, BlockHeader &block_header);
+
+bool ParseStreamHeader(const char *number_buffer, StreamHeader &header);
+
+bool DecompressBlocks(std::string_view file_contents, const uint64_t first_char,
+    const size_t num_chars, const bool check_checksums, const uint32_t dictionary_id,
+    const DecodeTable *dictionary_decode_table, char *output);
+
+bool DecodeBlockRange(const ParsedBlock &block, const size_t first_char, const size_t end_char,
+    char *output);
+
+bool DecodeRunsRange(std::string_view runs_data, const size_t first_char, const size_t end_char,
+    char *output);
+
+std::string DecompressWithTable(const DecodeTable &decode_table,
+    const CompressedFileRepr &file_data);
+
+size_t MinContentSize(const size_t code_repr_metadata_size) {
+    return FileHeader::MetadataSize() + code_repr_metadata_size
         + CompressedFileRepr::MetadataSize();
 }
 
-bool PartitionFileContents(const std::string file_contents, TreeFileRepr &tree_repr,
+uint32_t GetMagicNumber(std::string_view file_contents) {
+    uint32_t magic_number = 0;
+    if (file_contents.size() >= sizeof(magic_number)) {
+        memcpy(&magic_number, file_contents.data(), sizeof(magic_number));
+    }
+    return magic_number;
+}
+
+bool PartitionFileContents(std::string_view file_contents, TreeFileRepr &tree_repr,
     CompressedFileRepr &file_repr) {
-    std::string tree_and_file_data;
-    if (!PartitionHeader(file_contents, tree_and_file_data)) {
+    if (file_contents.size() < MinContentSize(TreeFileRepr::MetadataSize())) {
         return false;
     }
 
-    std::string file_repr_data;
+    std::string_view tree_and_file_data;
+    if (!PartitionHeader(file_contents, MAGIC_NUMBER_V1, tree_and_file_data)) {
+        return false;
+    }
+
+    std::string_view file_repr_data;
     if (!PartitionTree(tree_and_file_data, tree_repr, file_repr_data)) {
         return false;
     }
 
-    return ProcessFileReprData(file_repr_data, file_repr);
+    return ProcessFileReprData(file_repr_data, 0, file_repr);
 }
 
-bool PartitionHeader(
-    const std::string &file_contents, std::string &partitioned_tree_and_file_data) {
-    if (file_contents.size() < MinContentSize()) {
+bool PartitionFileContents(std::string_view file_contents,
+    CodeLengthsFileRepr &code_lengths_repr, CompressedFileRepr &file_repr) {
+    if (file_contents.size() < MinContentSize(CodeLengthsFileRepr::MetadataSize())) {
+        return false;
+    }
+
+    std::string_view code_lengths_and_file_data;
+    if (!PartitionHeader(file_contents, MAGIC_NUMBER_V2, code_lengths_and_file_data)) {
         return false;
     }
 
+    std::string_view file_repr_data;
+    if (!PartitionCodeLengths(code_lengths_and_file_data, code_lengths_repr, file_repr_data)) {
+        return false;
+    }
+
+    return ProcessFileReprData(file_repr_data, 0, file_repr);
+}
+
+bool PartitionHeader(std::string_view file_contents, const uint32_t expected_magic_number,
+    std::string_view &partitioned_tree_and_file_data) {
     const char *contents_buffer = file_contents.data();
     FileHeader header;
     memcpy(&header.magic_number, contents_buffer, sizeof(header.magic_number));
-    if (header.magic_number != MAGIC_NUMBER) {
+    if (header.magic_number != expected_magic_number) {
         std::cerr << "The file's magic number doesn't match what's expected!" << std::endl;
         return false;
     }
@@ -62,8 +118,8 @@ bool PartitionHeader(
     }
 
     partitioned_tree_and_file_data
-        = std::string(file_contents, sizeof(FileHeader), header.content_length);
-    if (header.checksum != ComputeChecksum(partitioned_tree_and_file_data)) {
+        = file_contents.substr(FileHeader::MetadataSize(), header.content_length);
+    if (header.checksum != ComputeChecksum(partitioned_tree_and_file_data, CHECKSUM_SIMPLE)) {
         std::cerr << "Expected checksum does not match actual checksum!" << std::endl;
         return false;
     }
@@ -71,8 +127,8 @@ bool PartitionHeader(
     return true;
 }
 
-bool PartitionTree(const std::string &tree_and_file_data, TreeFileRepr &tree_repr,
-    std::string &partitioned_file_data) {
+bool PartitionTree(std::string_view tree_and_file_data, TreeFileRepr &tree_repr,
+    std::string_view &partitioned_file_data) {
     const char *contents_buffer = tree_and_file_data.data();
 
     int remaining_size = tree_and_file_data.size() - TreeFileRepr::MetadataSize();
@@ -94,11 +150,11 @@ bool PartitionTree(const std::string &tree_and_file_data, TreeFileRepr &tree_rep
     tree_repr = TreeFileRepr {
         num_nodes,
         special_leaf_index,
-        std::string(tree_and_file_data, TreeFileRepr::MetadataSize(), num_nodes)
+        tree_and_file_data.substr(TreeFileRepr::MetadataSize(), num_nodes),
+        nullptr
     };
 
-    partitioned_file_data
-        = std::string(tree_and_file_data, TreeFileRepr::MetadataSize() + num_nodes);
+    partitioned_file_data = tree_and_file_data.substr(TreeFileRepr::MetadataSize() + num_nodes);
 
     if (partitioned_file_data.size() < CompressedFileRepr::MetadataSize()) {
         std::cerr << "Remaining file not big enough for CompressedFileRepr region!" << std::endl;
@@ -108,26 +164,867 @@ bool PartitionTree(const std::string &tree_and_file_data, TreeFileRepr &tree_rep
     return true;
 }
 
-bool ProcessFileReprData(const std::string &file_repr_data, CompressedFileRepr &file_repr) {
+bool PartitionCodeLengths(std::string_view code_lengths_and_file_data,
+    CodeLengthsFileRepr &code_lengths_repr, std::string_view &partitioned_file_data) {
+    const char *contents_buffer = code_lengths_and_file_data.data();
+    size_t remaining_size
+        = code_lengths_and_file_data.size() - CodeLengthsFileRepr::MetadataSize();
+
+    uint16_t num_chars;
+    memcpy(&num_chars, contents_buffer, sizeof(num_chars));
+    uint8_t max_length;
+    memcpy(&max_length, contents_buffer + sizeof(num_chars), sizeof(max_length));
+    if (num_chars == 0 || num_chars > NUM_CHARS || max_length == 0) {
+        std::cerr << "Invalid number of chars or bit sequence length!" << std::endl;
+        return false;
+    }
+
+    size_t num_length_counts = max_length - 1;
+    if (num_length_counts + num_chars > remaining_size) {
+        std::cerr << "Code lengths exceed remaining file size!" << std::endl;
+        return false;
+    }
+
+    code_lengths_repr = CodeLengthsFileRepr {
+        num_chars,
+        max_length,
+        std::string(code_lengths_and_file_data.substr(CodeLengthsFileRepr::MetadataSize(),
+            num_length_counts)),
+        std::string(code_lengths_and_file_data.substr(
+            CodeLengthsFileRepr::MetadataSize() + num_length_counts, num_chars))
+    };
+
+    partitioned_file_data = code_lengths_and_file_data.substr(
+        CodeLengthsFileRepr::MetadataSize() + num_length_counts + num_chars);
+
+    return true;
+}
+
+bool ReadStreamHeader(std::istream &input, StreamHeader &header) {
+    char number_buffer[StreamHeader::MetadataSize() - sizeof(header.magic_number)];
+    if (!input.read(number_buffer, sizeof(number_buffer))) {
+        std::cerr << "The file ends partway through its header!" << std::endl;
+        return false;
+    }
+    return ParseStreamHeader(number_buffer, header);
+}
+
+bool ParseStreamHeader(const char *number_buffer, StreamHeader &header) {
+    memcpy(&header.block_size, number_buffer, sizeof(header.block_size));
+    memcpy(&header.flags, number_buffer + sizeof(header.block_size), sizeof(header.flags));
+
+    if (header.block_size == 0 || header.block_size > MAX_BLOCK_SIZE) {
+        std::cerr << "The file's block size is not supported!" << std::endl;
+        return false;
+    }
+    if ((header.flags & ~SUPPORTED_FLAGS) != 0
+        || header.flags == (FLAG_SYNC_POINTS | FLAG_INTERLEAVED_STREAMS)) {
+        std::cerr << "The file uses features that are not supported!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ScanUncompressedSize(std::string_view file_contents, uint64_t &uncompressed_size) {
+    if (file_contents.size() < StreamHeader::MetadataSize()
+        || GetMagicNumber(file_contents) != MAGIC_NUMBER_V3) {
+        return false;
+    }
+
+    uncompressed_size = 0;
+    size_t offset = StreamHeader::MetadataSize();
+    while (file_contents.size() - offset >= BlockHeader::MetadataSize()) {
+        BlockHeader header;
+        ParseBlockHeader(file_contents.data() + offset, header);
+
+        if (header.block_type == BLOCK_END) {
+            return true;
+        }
+        offset += BlockHeader::MetadataSize();
+        if (file_contents.size() - offset < header.content_length) {
+            return false;
+        }
+        offset += header.content_length;
+        uncompressed_size += header.uncompressed_length;
+    }
+    return false;
+}
+
+size_t MaxBlockContentSize(const StreamHeader &stream_header) {
+    size_t max_size = CodeLengthsFileRepr::MetadataSize() + CANONICAL_LENGTH_LIMIT + NUM_CHARS
+        + CompressedFileRepr::MetadataSize()
+        + static_cast<size_t>(stream_header.block_size) * CANONICAL_LENGTH_LIMIT / BITS_PER_ELEM;
+    // a BLOCK_CONTEXT block also holds its context map and the code lengths of its other tables
+    max_size += ContextMapFileRepr::MetadataSize() + (MAX_CONTEXT_TABLES - 1)
+        * (CodeLengthsFileRepr::MetadataSize() + CANONICAL_LENGTH_LIMIT + NUM_CHARS);
+    if (stream_header.flags & FLAG_SYNC_POINTS) {
+        max_size += SyncPointsFileRepr::MetadataSize()
+            + stream_header.block_size / MIN_SYNC_INTERVAL * SyncPointsFileRepr::PointSize();
+    }
+    if (stream_header.flags & FLAG_INTERLEAVED_STREAMS) {
+        // the streams' lengths, and up to a byte of padding after every stream but the last
+        max_size += (NUM_INTERLEAVED_STREAMS - 1) * (sizeof(uint64_t) + 1);
+    }
+    return max_size;
+}
+
+bool ReadBlock(std::istream &input, const StreamHeader &stream_header, BlockHeader &block_header,
+    std::string &block_content) {
+    char number_buffer[BlockHeader::MetadataSize()];
+    if (!input.read(number_buffer, sizeof(number_buffer))) {
+        std::cerr << "The file ends before its last block!" << std::endl;
+        return false;
+    }
+    ParseBlockHeader(number_buffer, block_header);
+    if (!ValidateBlockHeader(stream_header, block_header)) {
+        return false;
+    }
+
+    block_content.resize(block_header.content_length);
+    if (!input.read(&block_content[0], block_header.content_length)) {
+        std::cerr << "The file ends partway through a block!" << std::endl;
+        return false;
+    }
+    if (block_header.checksum
+        != ComputeChecksum(block_content, BlockChecksumType(stream_header.flags))) {
+        std::cerr << "Expected checksum does not match actual checksum!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool ReadBlock(std::string_view &input, const StreamHeader &stream_header,
+    BlockHeader &block_header, std::string_view &block_content) {
+    if (input.size() < BlockHeader::MetadataSize()) {
+        std::cerr << "The file ends before its last block!" << std::endl;
+        return false;
+    }
+    ParseBlockHeader(input.data(), block_header);
+    input.remove_prefix(BlockHeader::MetadataSize());
+    if (!ValidateBlockHeader(stream_header, block_header)) {
+        return false;
+    }
+
+    if (input.size() < block_header.content_length) {
+        std::cerr << "The file ends partway through a block!" << std::endl;
+        return false;
+    }
+    block_content = input.substr(0, block_header.content_length);
+    input.remove_prefix(block_header.content_length);
+    if (block_header.checksum
+        != ComputeChecksum(block_content, BlockChecksumType(stream_header.flags))) {
+        std::cerr << "Expected checksum does not match actual checksum!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void ParseBlockHeader(const char *number_buffer, BlockHeader &block_header) {
+    const char *next = number_buffer;
+    memcpy(&block_header.block_type, next, sizeof(block_header.block_type));
+    next += sizeof(block_header.block_type);
+    memcpy(&block_header.checksum, next, sizeof(block_header.checksum));
+    next += sizeof(block_header.checksum);
+    memcpy(&block_header.uncompressed_length, next, sizeof(block_header.uncompressed_length));
+    next += sizeof(block_header.uncompressed_length);
+    memcpy(&block_header.content_length, next, sizeof(block_header.content_length));
+}
+
+bool ValidateBlockHeader(const StreamHeader &stream_header, const BlockHeader &block_header) {
+    if (block_header.block_type != BLOCK_END && block_header.block_type != BLOCK_HUFFMAN
+        && block_header.block_type != BLOCK_DICTIONARY
+        && block_header.block_type != BLOCK_REPEAT
+        && block_header.block_type != BLOCK_CONTEXT
+        && block_header.block_type != BLOCK_STORED
+        && block_header.block_type != BLOCK_RUNS) {
+        std::cerr << "The block's type is not supported!" << std::endl;
+        return false;
+    }
+    if (block_header.uncompressed_length > stream_header.block_size
+        || block_header.content_length > MaxBlockContentSize(stream_header)) {
+        std::cerr << "The block's length fields exceed the file's block size!" << std::endl;
+        return false;
+    }
+    // only the end block is empty; no block is ever written for no bytes
+    if (block_header.block_type != BLOCK_END && block_header.uncompressed_length == 0) {
+        std::cerr << "The block holds no bytes!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool PartitionBlockContents(std::string_view block_content, const uint32_t stream_flags,
+    CodeLengthsFileRepr &code_lengths_repr, CompressedFileRepr &file_repr,
+    SyncPointsFileRepr &sync_points_repr) {
+    if (block_content.size() < CodeLengthsFileRepr::MetadataSize()) {
+        std::cerr << "Block not big enough for CodeLengthsFileRepr region!" << std::endl;
+        return false;
+    }
+
+    std::string_view file_repr_data;
+    if (!PartitionCodeLengths(block_content, code_lengths_repr, file_repr_data)) {
+        return false;
+    }
+
+    return ProcessBlockFileReprData(file_repr_data, stream_flags, file_repr, sync_points_repr);
+}
+
+bool PartitionBlockContents(std::string_view block_content, const uint32_t stream_flags,
+    uint32_t &dictionary_id, CompressedFileRepr &file_repr, SyncPointsFileRepr &sync_points_repr) {
+    if (block_content.size() < sizeof(dictionary_id)) {
+        std::cerr << "Block not big enough for its dictionary ID!" << std::endl;
+        return false;
+    }
+    memcpy(&dictionary_id, block_content.data(), sizeof(dictionary_id));
+
+    return ProcessBlockFileReprData(block_content.substr(sizeof(dictionary_id)), stream_flags,
+        file_repr, sync_points_repr);
+}
+
+bool PartitionBlockContents(std::string_view block_content, const uint32_t stream_flags,
+    CompressedFileRepr &file_repr, SyncPointsFileRepr &sync_points_repr) {
+    return ProcessBlockFileReprData(block_content, stream_flags, file_repr, sync_points_repr);
+}
+
+bool PartitionBlockContents(std::string_view block_content,
+    ContextMapFileRepr &context_map_repr, std::vector<CodeLengthsFileRepr> &tables_repr,
+    CompressedFileRepr &file_repr) {
+    if (block_content.size() < ContextMapFileRepr::MetadataSize()) {
+        std::cerr << "Block not big enough for ContextMapFileRepr region!" << std::endl;
+        return false;
+    }
+    context_map_repr.num_tables = block_content[0];
+    memcpy(context_map_repr.context_tables.data(), block_content.data() + 1, NUM_CHARS);
+    if (context_map_repr.num_tables == 0 || context_map_repr.num_tables > MAX_CONTEXT_TABLES
+        || *std::max_element(context_map_repr.context_tables.begin(),
+            context_map_repr.context_tables.end()) >= context_map_repr.num_tables) {
+        std::cerr << "Invalid number of tables or context map!" << std::endl;
+        return false;
+    }
+
+    std::string_view remaining_data = block_content.substr(ContextMapFileRepr::MetadataSize());
+    tables_repr.resize(context_map_repr.num_tables);
+    for (CodeLengthsFileRepr &table_repr : tables_repr) {
+        if (remaining_data.size() < CodeLengthsFileRepr::MetadataSize()) {
+            std::cerr << "Block not big enough for CodeLengthsFileRepr region!" << std::endl;
+            return false;
+        }
+        if (!PartitionCodeLengths(remaining_data, table_repr, remaining_data)) {
+            return false;
+        }
+    }
+
+    // the bits of a BLOCK_CONTEXT block are one stream, without sync points
+    return ProcessFileReprData(remaining_data, 0, file_repr);
+}
+
+bool PartitionDictionary(std::string_view dictionary_contents, uint32_t &dictionary_id,
+    CodeLengthsFileRepr &code_lengths_data) {
+    if (dictionary_contents.size()
+        < DictionaryHeader::MetadataSize() + CodeLengthsFileRepr::MetadataSize()
+        || GetMagicNumber(dictionary_contents) != MAGIC_NUMBER_DICT) {
+        std::cerr << "The dictionary file isn't a dictionary!" << std::endl;
+        return false;
+    }
+    memcpy(&dictionary_id, dictionary_contents.data() + sizeof(uint32_t), sizeof(dictionary_id));
+
+    std::string_view remaining_data;
+    if (!PartitionCodeLengths(dictionary_contents.substr(DictionaryHeader::MetadataSize()),
+        code_lengths_data, remaining_data)) {
+        return false;
+    }
+    if (!remaining_data.empty() || dictionary_id != ComputeDictionaryId(code_lengths_data)) {
+        std::cerr << "The dictionary's ID doesn't match its contents!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ProcessBlockFileReprData(std::string_view file_repr_data, const uint32_t stream_flags,
+    CompressedFileRepr &file_repr, SyncPointsFileRepr &sync_points_repr) {
+    if (!ProcessFileReprData(file_repr_data, stream_flags, file_repr)) {
+        return false;
+    }
+
+    sync_points_repr = SyncPointsFileRepr { 0, { } };
+    if (!(stream_flags & FLAG_SYNC_POINTS)) {
+        return true;
+    }
+    size_t file_repr_size = CompressedFileRepr::MetadataSize()
+        + file_repr.stream_num_bits.size() * sizeof(uint64_t) + file_repr.compressed_bits.size();
+    return ProcessSyncPointsData(file_repr_data.substr(file_repr_size), sync_points_repr);
+}
+
+uint64_t NumBytesForBits(const uint64_t num_bits) {
+    return num_bits / BITS_PER_ELEM + static_cast<int>(num_bits % BITS_PER_ELEM != 0);
+}
+
+bool ProcessFileReprData(std::string_view file_repr_data, const uint32_t stream_flags,
+    CompressedFileRepr &file_repr) {
     const char *contents_buffer = file_repr_data.data();
-    uint64_t remaining_size = file_repr_data.size() - CompressedFileRepr::MetadataSize();
+    size_t metadata_size = CompressedFileRepr::MetadataSize();
+    if (file_repr_data.size() < metadata_size) {
+        std::cerr << "Remaining file not big enough for CompressedFileRepr region!" << std::endl;
+        return false;
+    }
 
     uint64_t num_bits;
     memcpy(&num_bits, contents_buffer, sizeof(num_bits));
-    uint64_t num_bytes = num_bits / BITS_PER_ELEM + static_cast<int>(num_bits % BITS_PER_ELEM != 0);
-    if (num_bytes > remaining_size) {
+    uint64_t num_bytes = NumBytesForBits(num_bits);
+
+    std::vector<uint64_t> stream_num_bits;
+    if (stream_flags & FLAG_INTERLEAVED_STREAMS) {
+        metadata_size += (NUM_INTERLEAVED_STREAMS - 1) * sizeof(uint64_t);
+        if (file_repr_data.size() < metadata_size) {
+            std::cerr << "Remaining file not big enough for CompressedFileRepr region!"
+                << std::endl;
+            return false;
+        }
+
+        // every stream but the last is padded to a byte boundary
+        stream_num_bits.resize(NUM_INTERLEAVED_STREAMS - 1);
+        uint64_t last_stream_bits = num_bits;
+        num_bytes = 0;
+        for (size_t i = 0; i < stream_num_bits.size(); i++) {
+            memcpy(&stream_num_bits[i], contents_buffer + sizeof(num_bits) + i * sizeof(uint64_t),
+                sizeof(uint64_t));
+            if (stream_num_bits[i] > last_stream_bits) {
+                std::cerr << "The streams' lengths exceed the number of bits!" << std::endl;
+                return false;
+            }
+            last_stream_bits -= stream_num_bits[i];
+            num_bytes += NumBytesForBits(stream_num_bits[i]);
+        }
+        num_bytes += NumBytesForBits(last_stream_bits);
+    }
+
+    if (num_bytes > file_repr_data.size() - metadata_size) {
         std::cerr << "Number of bits exceeds remaining file size!" << std::endl;
         return false;
     }
 
     file_repr = CompressedFileRepr {
         num_bits,
-        std::string(file_repr_data, CompressedFileRepr::MetadataSize(), num_bytes)
+        file_repr_data.substr(metadata_size, num_bytes),
+        nullptr,
+        stream_num_bits
     };
 
     return true;
 }
 
+bool ProcessSyncPointsData(std::string_view sync_points_data,
+    SyncPointsFileRepr &sync_points_repr) {
+    if (sync_points_data.size() < SyncPointsFileRepr::MetadataSize()) {
+        std::cerr << "Block not big enough for SyncPointsFileRepr region!" << std::endl;
+        return false;
+    }
+
+    const char *next = sync_points_data.data();
+    uint32_t num_points;
+    memcpy(&num_points, next, sizeof(num_points));
+    next += sizeof(num_points);
+    size_t remaining_size = sync_points_data.size() - SyncPointsFileRepr::MetadataSize();
+    if (num_points > remaining_size / SyncPointsFileRepr::PointSize()) {
+        std::cerr << "Number of sync points exceeds remaining file size!" << std::endl;
+        return false;
+    }
+
+    sync_points_repr.num_points = num_points;
+    sync_points_repr.points.resize(num_points);
+    for (SyncPoint &point : sync_points_repr.points) {
+        memcpy(&point.bit_offset, next, sizeof(point.bit_offset));
+        next += sizeof(point.bit_offset);
+        memcpy(&point.byte_offset, next, sizeof(point.byte_offset));
+        next += sizeof(point.byte_offset);
+    }
+
+    return true;
+}
+
+bool SyncPointsToSegments(const SyncPointsFileRepr &sync_points_repr,
+    const CompressedFileRepr &file_repr, const uint32_t uncompressed_length,
+    std::vector<BlockSegment> &segments) {
+    segments.clear();
+    SyncPoint start = { 0, 0 };
+    for (size_t i = 0; i <= sync_points_repr.points.size(); i++) {
+        SyncPoint end = i < sync_points_repr.points.size()
+            ? sync_points_repr.points[i]
+            : SyncPoint { file_repr.num_bits, uncompressed_length };
+        // each char takes up at least one bit, so both offsets must strictly increase
+        if (end.bit_offset <= start.bit_offset || end.byte_offset <= start.byte_offset
+            || end.bit_offset > file_repr.num_bits || end.byte_offset > uncompressed_length) {
+            std::cerr << "The block's sync points are out of order!" << std::endl;
+            return false;
+        }
+        segments.push_back({
+            start.bit_offset,
+            end.bit_offset - start.bit_offset,
+            start.byte_offset,
+            end.byte_offset - start.byte_offset
+        });
+        start = end;
+    }
+    return true;
+}
+
+void InterleavedStreamsToSegments(const CompressedFileRepr &file_repr,
+    const uint32_t uncompressed_length, std::vector<BlockSegment> &segments) {
+    segments.clear();
+    const size_t stream_length = InterleavedStreamLength(uncompressed_length);
+    uint64_t first_bit = 0;
+    uint64_t remaining_bits = file_repr.num_bits;
+    for (int i = 0; i < NUM_INTERLEAVED_STREAMS; i++) {
+        uint64_t stream_bits = i + 1 < NUM_INTERLEAVED_STREAMS
+            ? file_repr.stream_num_bits[i] : remaining_bits;
+        size_t first_char = std::min<size_t>(uncompressed_length, i * stream_length);
+        size_t end_char = i + 1 < NUM_INTERLEAVED_STREAMS
+            ? std::min<size_t>(uncompressed_length, (i + 1) * stream_length) : uncompressed_length;
+        segments.push_back({ first_bit, stream_bits, first_char, end_char - first_char });
+
+        first_bit += NumBytesForBits(stream_bits) * BITS_PER_ELEM;
+        remaining_bits -= stream_bits;
+    }
+}
+
+bool DecompressInterleavedSegments(const DecodeTable &decode_table,
+    const CompressedFileRepr &file_repr, const std::vector<BlockSegment> &segments,
+    char *output) {
+    std::vector<BitReader> readers;
+    std::vector<uint64_t> num_bits;
+    std::vector<char *> outputs;
+    std::vector<size_t> num_chars;
+    for (const BlockSegment &segment : segments) {
+        const size_t first_byte = segment.first_bit / BITS_PER_ELEM;
+        readers.emplace_back(file_repr.compressed_bits.data() + first_byte,
+            file_repr.compressed_bits.size() - first_byte);
+        num_bits.push_back(segment.num_bits);
+        outputs.push_back(output + segment.first_char);
+        num_chars.push_back(segment.num_chars);
+    }
+
+    if (!decode_table.DecodeInterleaved(segments.size(), readers.data(), num_bits.data(),
+        outputs.data(), num_chars.data())) {
+        std::cerr << "The block's streams don't decode into its uncompressed length!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DecompressSegment(const DecodeTable &decode_table, const CompressedFileRepr &file_repr,
+    const BlockSegment &segment, char *output) {
+    const size_t first_byte = segment.first_bit / BITS_PER_ELEM;
+    BitReader reader(file_repr.compressed_bits.data() + first_byte,
+        file_repr.compressed_bits.size() - first_byte);
+    reader.Refill();
+    reader.Consume(segment.first_bit % BITS_PER_ELEM);
+
+    if (!decode_table.Decode(reader, segment.num_bits, output, segment.num_chars)) {
+        std::cerr << "The block's bit sequences don't line up with its sync points!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DecompressWithContexts(const std::vector<DecodeTable> &decode_tables,
+    const ContextMap &context_tables, const CompressedFileRepr &file_repr, char *output,
+    const size_t num_chars) {
+    const DecodeTable *context_decode_tables[NUM_CHARS];
+    for (int c = 0; c < NUM_CHARS; c++) {
+        context_decode_tables[c] = &decode_tables[context_tables[c]];
+    }
+    BitReader reader(file_repr.compressed_bits.data(), file_repr.compressed_bits.size());
+    if (!DecodeTable::DecodeWithContexts(context_decode_tables, reader, file_repr.num_bits, output,
+        num_chars)) {
+        std::cerr << "The block's bit sequences don't decode into its length!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool DecodeRuns(std::string_view runs_data, char *output, const size_t num_chars) {
+    size_t num_chars_read = 0;
+    size_t next = 0;
+    while (next < runs_data.size()) {
+        const char c = runs_data[next++];
+        uint64_t run_length = 0;
+        for (int shift = 0;; shift += 7) {
+            if (next == runs_data.size() || shift >= 64) {
+                std::cerr << "The block's runs are cut off!" << std::endl;
+                return false;
+            }
+            const unsigned char length_byte = runs_data[next++];
+            run_length |= static_cast<uint64_t>(length_byte & 0x7f) << shift;
+            if (!(length_byte & 0x80)) {
+                break;
+            }
+        }
+        if (run_length > num_chars - num_chars_read) {
+            std::cerr << "The block's runs exceed its length!" << std::endl;
+            return false;
+        }
+        memset(output + num_chars_read, c, run_length);
+        num_chars_read += run_length;
+    }
+    if (num_chars_read != num_chars) {
+        std::cerr << "The block's runs don't add up to its length!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ParseBlock(const uint32_t stream_flags, const BlockHeader &block_header,
+    std::string_view block_content, const uint32_t dictionary_id,
+    const std::shared_ptr<const DecodeTable> &dictionary_decode_table,
+    std::shared_ptr<const DecodeTable> &previous_decode_table, ParsedBlock &block) {
+    block.header = block_header;
+    block.content = block_content;
+    block.interleaved = stream_flags & FLAG_INTERLEAVED_STREAMS;
+    const uint32_t block_type = block_header.block_type;
+
+    // raw and context blocks have no table for a BLOCK_REPEAT block to reuse
+    if (block_type == BLOCK_STORED || block_type == BLOCK_RUNS) {
+        previous_decode_table = nullptr;
+        if (block_type == BLOCK_STORED
+            && block_content.size() != block_header.uncompressed_length) {
+            std::cerr << "The stored block's content size doesn't match its uncompressed size!"
+                << std::endl;
+            return false;
+        }
+        return true;
+    }
+    if (block_type == BLOCK_CONTEXT) {
+        previous_decode_table = nullptr;
+        if (!PartitionBlockContents(block_content, block.context_map_data, block.tables_data,
+            block.file_data)) {
+            return false;
+        }
+        for (const CodeLengthsFileRepr &table_data : block.tables_data) {
+            CodeLengths code_lengths;
+            if (!CodeLengthsReprToCodeLengths(table_data, code_lengths)) {
+                return false;
+            }
+            block.context_decode_tables.emplace_back(code_lengths);
+        }
+        return true;
+    }
+
+    if (block_type == BLOCK_DICTIONARY) {
+        if (!PartitionBlockContents(block_content, stream_flags, block.dictionary_id,
+            block.file_data, block.sync_points_data)) {
+            return false;
+        }
+        if (!dictionary_decode_table) {
+            std::cerr << "The block was compressed with a dictionary that wasn't given!"
+                << std::endl;
+            return false;
+        }
+        if (block.dictionary_id != dictionary_id) {
+            std::cerr << "The block was compressed with a different dictionary!" << std::endl;
+            return false;
+        }
+        block.decode_table = dictionary_decode_table;
+    } else if (block_type == BLOCK_REPEAT) {
+        if (!PartitionBlockContents(block_content, stream_flags, block.file_data,
+            block.sync_points_data)) {
+            return false;
+        }
+        if (!previous_decode_table) {
+            std::cerr << "The block before this one has no bit sequences for it to reuse!"
+                << std::endl;
+            return false;
+        }
+        block.decode_table = previous_decode_table;
+    } else {
+        if (!PartitionBlockContents(block_content, stream_flags, block.code_lengths_data,
+            block.file_data, block.sync_points_data)
+            || !CodeLengthsReprToCodeLengths(block.code_lengths_data, block.code_lengths)) {
+            return false;
+        }
+        block.decode_table = std::make_shared<const DecodeTable>(block.code_lengths);
+    }
+    previous_decode_table = block.decode_table;
+
+    if (block.interleaved) {
+        InterleavedStreamsToSegments(block.file_data, block_header.uncompressed_length,
+            block.segments);
+        return true;
+    }
+    return SyncPointsToSegments(block.sync_points_data, block.file_data,
+        block_header.uncompressed_length, block.segments);
+}
+
+size_t NumBlockParts(const ParsedBlock &block) {
+    return block.decode_table && !block.interleaved ? block.segments.size() : 1;
+}
+
+bool DecodeBlockPart(const ParsedBlock &block, const size_t part, char *output) {
+    const uint32_t block_type = block.header.block_type;
+    const size_t num_chars = block.header.uncompressed_length;
+    if (block_type == BLOCK_STORED) {
+        memcpy(output, block.content.data(), num_chars);
+        return true;
+    } else if (block_type == BLOCK_RUNS) {
+        return DecodeRuns(block.content, output, num_chars);
+    } else if (block_type == BLOCK_CONTEXT) {
+        return DecompressWithContexts(block.context_decode_tables,
+            block.context_map_data.context_tables, block.file_data, output, num_chars);
+    } else if (block.interleaved) {
+        return DecompressInterleavedSegments(*block.decode_table, block.file_data,
+            block.segments, output);
+    }
+    const BlockSegment &segment = block.segments[part];
+    return DecompressSegment(*block.decode_table, block.file_data, segment,
+        output + segment.first_char);
+}
+
+bool DecompressRange(std::string_view file_contents, const uint64_t first_char,
+    const size_t num_chars, const uint32_t dictionary_id,
+    const DecodeTable *dictionary_decode_table, char *output) {
+    return DecompressBlocks(file_contents, first_char, num_chars, false, dictionary_id,
+        dictionary_decode_table, output);
+}
+
+bool DecompressFile(std::string_view file_contents, const uint32_t dictionary_id,
+    const DecodeTable *dictionary_decode_table, char *output, const size_t num_chars) {
+    // an empty file compresses to another empty file
+    if (file_contents.empty()) {
+        return num_chars == 0;
+    }
+    uint64_t uncompressed_size;
+    if (!ScanUncompressedSize(file_contents, uncompressed_size)) {
+        std::cerr << "The file isn't a compressed file with blocks!" << std::endl;
+        return false;
+    }
+    if (uncompressed_size != num_chars) {
+        std::cerr << "The output's size doesn't match the file's uncompressed size!" << std::endl;
+        return false;
+    }
+    return DecompressBlocks(file_contents, 0, num_chars, true, dictionary_id,
+        dictionary_decode_table, output);
+}
+
+bool DecompressFile(std::string_view file_contents, const uint32_t dictionary_id,
+    const DecodeTable *dictionary_decode_table, std::string &output) {
+    uint64_t uncompressed_size = 0;
+    if (!file_contents.empty() && !ScanUncompressedSize(file_contents, uncompressed_size)) {
+        std::cerr << "The file isn't a compressed file with blocks!" << std::endl;
+        return false;
+    }
+    output.resize(uncompressed_size);
+    return DecompressFile(file_contents, dictionary_id, dictionary_decode_table, &output[0],
+        output.size());
+}
+
+bool DecompressBlocks(std::string_view file_contents, const uint64_t first_char,
+    const size_t num_chars, const bool check_checksums, const uint32_t dictionary_id,
+    const DecodeTable *dictionary_decode_table, char *output) {
+    StreamHeader stream_header;
+    if (file_contents.size() < StreamHeader::MetadataSize()
+        || GetMagicNumber(file_contents) != MAGIC_NUMBER_V3) {
+        std::cerr << "The file isn't a compressed file with blocks!" << std::endl;
+        return false;
+    }
+    stream_header.magic_number = MAGIC_NUMBER_V3;
+    if (!ParseStreamHeader(file_contents.data() + sizeof(stream_header.magic_number),
+        stream_header)) {
+        return false;
+    }
+
+    // the dictionary outlives the blocks decoded with it, so they needn't share ownership of it
+    const std::shared_ptr<const DecodeTable> dictionary_table(
+        std::shared_ptr<const DecodeTable>(), dictionary_decode_table);
+    // blocks before the range aren't parsed; the last of them with its own bit sequences is kept
+    // for a BLOCK_REPEAT block at the start of the range to reuse
+    bool has_table_block = false;
+    BlockHeader table_block_header;
+    std::string_view table_block_content;
+    std::shared_ptr<const DecodeTable> previous_decode_table;
+    std::string_view remaining_contents = file_contents.substr(StreamHeader::MetadataSize());
+    const uint64_t end_char = first_char + num_chars;
+    for (uint64_t block_first_char = 0; block_first_char < end_char;) {
+        BlockHeader block_header;
+        std::string_view block_content;
+        if (remaining_contents.size() < BlockHeader::MetadataSize()) {
+            std::cerr << "The file ends before its last block!" << std::endl;
+            return false;
+        }
+        ParseBlockHeader(remaining_contents.data(), block_header);
+        remaining_contents.remove_prefix(BlockHeader::MetadataSize());
+        if (!ValidateBlockHeader(stream_header, block_header)) {
+            return false;
+        }
+        if (block_header.block_type == BLOCK_END) {
+            std::cerr << "The range goes past the end of the file!" << std::endl;
+            return false;
+        }
+        if (remaining_contents.size() < block_header.content_length) {
+            std::cerr << "The file ends partway through a block!" << std::endl;
+            return false;
+        }
+        // unless its checksum is checked, only the parts of block_content that the range needs
+        // are read
+        block_content = remaining_contents.substr(0, block_header.content_length);
+        remaining_contents.remove_prefix(block_header.content_length);
+
+        const uint64_t block_end_char = block_first_char + block_header.uncompressed_length;
+        if (block_end_char <= first_char) {
+            if (block_header.block_type == BLOCK_HUFFMAN
+                || block_header.block_type == BLOCK_DICTIONARY) {
+                has_table_block = true;
+                table_block_header = block_header;
+                table_block_content = block_content;
+            } else if (block_header.block_type != BLOCK_REPEAT) {
+                has_table_block = false;
+            }
+            block_first_char = block_end_char;
+            continue;
+        }
+
+        if (check_checksums && block_header.checksum
+            != ComputeChecksum(block_content, BlockChecksumType(stream_header.flags))) {
+            std::cerr << "Expected checksum does not match actual checksum!" << std::endl;
+            return false;
+        }
+        ParsedBlock table_block;
+        if (block_header.block_type == BLOCK_REPEAT && !previous_decode_table && has_table_block
+            && !ParseBlock(stream_header.flags, table_block_header, table_block_content,
+                dictionary_id, dictionary_table, previous_decode_table, table_block)) {
+            return false;
+        }
+        ParsedBlock block;
+        if (!ParseBlock(stream_header.flags, block_header, block_content, dictionary_id,
+            dictionary_table, previous_decode_table, block)) {
+            return false;
+        }
+        const uint64_t range_first_char = std::max(first_char, block_first_char);
+        if (!DecodeBlockRange(block, range_first_char - block_first_char,
+            std::min(end_char, block_end_char) - block_first_char,
+            output + (range_first_char - first_char))) {
+            return false;
+        }
+        block_first_char = block_end_char;
+    }
+    return true;
+}
+
+bool DecodeBlockRange(const ParsedBlock &block, const size_t first_char, const size_t end_char,
+    char *output) {
+    if (first_char == end_char) {
+        return true;
+    }
+    // a whole block is decoded, and checked, the same way as when decompressing a whole file
+    if (first_char == 0 && end_char == block.header.uncompressed_length) {
+        for (size_t part = 0; part < NumBlockParts(block); part++) {
+            if (!DecodeBlockPart(block, part, output)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (block.header.block_type == BLOCK_STORED) {
+        memcpy(output, block.content.data() + first_char, end_char - first_char);
+        return true;
+    }
+    if (block.header.block_type == BLOCK_RUNS) {
+        return DecodeRunsRange(block.content, first_char, end_char, output);
+    }
+
+    // each char of a BLOCK_CONTEXT block depends on the one before it,
+    // so the block is decoded from its start
+    if (block.header.block_type == BLOCK_CONTEXT) {
+        const DecodeTable *context_decode_tables[NUM_CHARS];
+        for (int c = 0; c < NUM_CHARS; c++) {
+            context_decode_tables[c]
+                = &block.context_decode_tables[block.context_map_data.context_tables[c]];
+        }
+        // a range from the start of the block is decoded straight into output
+        std::string block_bytes(first_char == 0 ? 0 : end_char, '\0');
+        char *decoded = first_char == 0 ? output : &block_bytes[0];
+        BitReader reader(block.file_data.compressed_bits.data(),
+            block.file_data.compressed_bits.size());
+        if (!DecodeTable::DecodePrefixWithContexts(context_decode_tables, reader,
+            block.file_data.num_bits, decoded, end_char)) {
+            std::cerr << "The block's bit sequences don't decode into its length!" << std::endl;
+            return false;
+        }
+        if (first_char != 0) {
+            memcpy(output, block_bytes.data() + first_char, end_char - first_char);
+        }
+        return true;
+    }
+
+    // only the segments (between sync points, or interleaved streams) holding the range are
+    // decoded, each from its start up to the end of the range
+    std::vector<BlockSegment> segments = block.segments;
+    segments.erase(std::remove_if(segments.begin(), segments.end(),
+        [first_char, end_char](const BlockSegment &segment) {
+            return segment.first_char + segment.num_chars <= first_char
+                || segment.first_char >= end_char;
+        }), segments.end());
+    // a range from the start of a segment is decoded straight into output
+    const size_t decoded_first_char = segments.front().first_char;
+    std::string decoded_bytes(decoded_first_char == first_char ? 0 : end_char - decoded_first_char,
+        '\0');
+    char *decoded = decoded_first_char == first_char ? output : &decoded_bytes[0];
+    for (const BlockSegment &segment : segments) {
+        const size_t segment_end_char = segment.first_char + segment.num_chars;
+        const size_t first_byte = segment.first_bit / BITS_PER_ELEM;
+        BitReader reader(block.file_data.compressed_bits.data() + first_byte,
+            block.file_data.compressed_bits.size() - first_byte);
+        reader.Refill();
+        reader.Consume(segment.first_bit % BITS_PER_ELEM);
+        if (!block.decode_table->DecodePrefix(reader, segment.num_bits,
+            decoded + (segment.first_char - decoded_first_char),
+            std::min(end_char, segment_end_char) - segment.first_char)) {
+            std::cerr << "The block's bit sequences don't decode into its length!" << std::endl;
+            return false;
+        }
+    }
+    if (decoded_first_char != first_char) {
+        memcpy(output, decoded_bytes.data() + (first_char - decoded_first_char),
+            end_char - first_char);
+    }
+    return true;
+}
+
+bool DecodeRunsRange(std::string_view runs_data, const size_t first_char, const size_t end_char,
+    char *output) {
+    size_t run_first_char = 0;
+    size_t next = 0;
+    while (run_first_char < end_char) {
+        if (next == runs_data.size()) {
+            std::cerr << "The block's runs don't add up to its length!" << std::endl;
+            return false;
+        }
+        const char c = runs_data[next++];
+        uint64_t run_length = 0;
+        for (int shift = 0;; shift += 7) {
+            if (next == runs_data.size() || shift >= 64) {
+                std::cerr << "The block's runs are cut off!" << std::endl;
+                return false;
+            }
+            const unsigned char length_byte = runs_data[next++];
+            run_length |= static_cast<uint64_t>(length_byte & 0x7f) << shift;
+            if (!(length_byte & 0x80)) {
+                break;
+            }
+        }
+        // the part of the run inside the range, if any
+        const uint64_t run_end_char = run_first_char + run_length;
+        if (run_end_char > first_char) {
+            const uint64_t from = std::max<uint64_t>(first_char, run_first_char);
+            const uint64_t to = std::min<uint64_t>(end_char, run_end_char);
+            memset(output + (from - first_char), c, to - from);
+        }
+        run_first_char = run_end_char;
+    }
+    return true;
+}
+
 NodePtr TreeReprToTree(const TreeFileRepr &tree_repr) {
     std::stack<NodePtr> tree_organizer;
     for (size_t i = 0; i < tree_repr.tree_data.size(); i++) {
@@ -148,32 +1045,54 @@ NodePtr TreeReprToTree(const TreeFileRepr &tree_repr) {
     return std::move(tree_organizer.top());
 }
 
-std::string DecompressFile(const huffman::TreeNode &root, const CompressedFileRepr &file_data) {
-    if (root.IsLeaf()) {
-        return std::string(file_data.num_bits, root.GetKey());
-    }
-    std::stringstream decompressed_output;
-    huffman::TreeNode const *current_node = &root;
+bool CodeLengthsReprToCodeLengths(const CodeLengthsFileRepr &code_lengths_repr,
+    CodeLengths &code_lengths) {
+    code_lengths = { };
+    size_t char_index = 0;
+    for (int length = 1; length <= code_lengths_repr.max_length; length++) {
+        size_t num_of_length = code_lengths_repr.num_chars - char_index;
+        if (length < code_lengths_repr.max_length) {
+            num_of_length = std::min<size_t>(
+                static_cast<unsigned char>(code_lengths_repr.length_counts.at(length - 1)),
+                num_of_length);
+        }
 
-    std::string::const_iterator byte_iterator = file_data.compressed_bits.begin();
-    unsigned char current_byte = *byte_iterator;
-    for (uint64_t i = 0; i < file_data.num_bits; i++) {
-        int bit_offset = i % BITS_PER_ELEM;
-        if (i != 0 && bit_offset == 0) {
-            byte_iterator++;
-            current_byte = *byte_iterator;
+        for (size_t i = 0; i < num_of_length; i++, char_index++) {
+            const unsigned char c = code_lengths_repr.chars.at(char_index);
+            if (code_lengths[c] != 0) {
+                std::cerr << "A char appears more than once in the code lengths!" << std::endl;
+                return false;
+            }
+            code_lengths[c] = length;
         }
+    }
+
+    if (code_lengths_repr.max_length > CANONICAL_LENGTH_LIMIT
+        || !CodeLengthsAreComplete(code_lengths)) {
+        std::cerr << "The code lengths do not describe a valid code!" << std::endl;
+        return false;
+    }
+    return true;
+}
 
-        bool bit_is_one = (current_byte >> bit_offset) & 0x1;
+std::string DecompressFile(const huffman::TreeNode &root, const CompressedFileRepr &file_data) {
+    return DecompressWithTable(DecodeTable(root), file_data);
+}
 
-        current_node = (bit_is_one ? current_node->GetRight() : current_node->GetLeft()).get();
-        if (current_node->IsLeaf()) {
-            decompressed_output << current_node->GetKey();
-            current_node = &root;
-        }
+std::string DecompressFile(const CodeLengths &code_lengths, const CompressedFileRepr &file_data) {
+    return DecompressWithTable(DecodeTable(code_lengths), file_data);
+}
+
+std::string DecompressWithTable(const DecodeTable &decode_table,
+    const CompressedFileRepr &file_data) {
+    BitReader reader(file_data.compressed_bits.data(), file_data.compressed_bits.size());
+
+    std::string decompressed_output;
+    if (!decode_table.Decode(reader, file_data.num_bits, decompressed_output)) {
+        std::cerr << "Compressed bits end partway through a character!" << std::endl;
     }
 
-    return decompressed_output.str();
+    return decompressed_output;
 }
 
 }  // namespace huffman
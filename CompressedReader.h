@@ -1,23 +1,207 @@
 #ifndef _COMPRESSEDREADER_H_
 #define _COMPRESSEDREADER_H_
 
+#include <istream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "CompressedWriter.h"
+#include "DecodeTable.h"
 
 namespace huffman {
 
-// Populates tree_data and file_data based on file_contents (which represents a compressed file)
-bool PartitionFileContents(const std::string file_contents, TreeFileRepr &tree_data,
+// Returns the magic number at the start of file_contents, or 0 if file_contents is too short.
+uint32_t GetMagicNumber(std::string_view file_contents);
+
+// Populates tree_data and file_data based on file_contents
+// (which represents a version 1 compressed file). tree_data and file_data view the bytes of
+// file_contents instead of copying them, so those bytes must outlive them.
+bool PartitionFileContents(std::string_view file_contents, TreeFileRepr &tree_data,
     CompressedFileRepr &file_data);
+// Populates code_lengths_data and file_data based on file_contents
+// (which represents a version 2 compressed file). Like above, file_data views file_contents.
+bool PartitionFileContents(std::string_view file_contents,
+    CodeLengthsFileRepr &code_lengths_data, CompressedFileRepr &file_data);
 
 // Constructs a tree based on the contents of tree_repr.
 // The weights of all nodes in this tree will be zero. Returns the root node of this tree.
 std::unique_ptr<huffman::TreeNode> TreeReprToTree(const TreeFileRepr &tree_repr);
 
+// Reads the fields of a StreamHeader that come after its magic number from input into header.
+// Returns false if input ends early or the header is invalid.
+bool ReadStreamHeader(std::istream &input, StreamHeader &header);
+
+// Adds up the uncompressed_length of every block of file_contents (which represents a version 3
+// compressed file) into uncompressed_size, jumping from block header to block header without
+// decompressing or checking the blocks. Returns false if file_contents isn't laid out like
+// a version 3 compressed file.
+bool ScanUncompressedSize(std::string_view file_contents, uint64_t &uncompressed_size);
+
+// Reads the next block of a (version 3) compressed file from input into block_header and
+// block_content. Returns false if input ends early, the block is invalid,
+// or its checksum doesn't match.
+bool ReadBlock(std::istream &input, const StreamHeader &stream_header, BlockHeader &block_header,
+    std::string &block_content);
+// Same as above, but reads from the start of the buffer that input views (moving input past the
+// block), and makes block_content view the block's content in that buffer instead of copying it.
+bool ReadBlock(std::string_view &input, const StreamHeader &stream_header,
+    BlockHeader &block_header, std::string_view &block_content);
+
+// Populates code_lengths_data, file_data and sync_points_data based on block_content
+// (the content of a BLOCK_HUFFMAN block in a file with the given StreamHeader flags).
+// sync_points_data is left empty if the file doesn't have FLAG_SYNC_POINTS.
+// file_data views the bytes of block_content, so those bytes must outlive it.
+bool PartitionBlockContents(std::string_view block_content, const uint32_t stream_flags,
+    CodeLengthsFileRepr &code_lengths_data, CompressedFileRepr &file_data,
+    SyncPointsFileRepr &sync_points_data);
+
+// Same as above, but for the content of a BLOCK_DICTIONARY block: populates dictionary_id
+// (instead of code_lengths_data) with the ID of the dictionary that the block was compressed with.
+bool PartitionBlockContents(std::string_view block_content, const uint32_t stream_flags,
+    uint32_t &dictionary_id, CompressedFileRepr &file_data, SyncPointsFileRepr &sync_points_data);
+
+// Same as above, but for the content of a BLOCK_REPEAT block, which only holds file_data
+// (and sync_points_data).
+bool PartitionBlockContents(std::string_view block_content, const uint32_t stream_flags,
+    CompressedFileRepr &file_data, SyncPointsFileRepr &sync_points_data);
+
+// Same as above, but for the content of a BLOCK_CONTEXT block: populates context_map_data,
+// tables_data (with the CodeLengthsFileRepr of each of its tables) and file_data. Returns false
+// if the context map picks a table that the block doesn't have.
+bool PartitionBlockContents(std::string_view block_content,
+    ContextMapFileRepr &context_map_data, std::vector<CodeLengthsFileRepr> &tables_data,
+    CompressedFileRepr &file_data);
+
+// Populates dictionary_id and code_lengths_data based on dictionary_contents (the contents of
+// a dictionary file). Returns false if dictionary_contents isn't a dictionary file, or its
+// dictionary_id doesn't match its bit sequence lengths.
+bool PartitionDictionary(std::string_view dictionary_contents, uint32_t &dictionary_id,
+    CodeLengthsFileRepr &code_lengths_data);
+
+// This struct represents a run of a block's compressed bits that can be decoded on its own.
+struct BlockSegment {
+    uint64_t first_bit;     // the offset of the segment's first bit in the compressed bits
+    uint64_t num_bits;      // the number of compressed bits in the segment
+    size_t first_char;      // the offset of the segment's first char in the uncompressed block
+    size_t num_chars;       // the number of uncompressed chars in the segment
+};
+
+// Populates segments with the runs of file_data's bits between the given sync points
+// (one segment if there are none). Returns false if the sync points are out of order or
+// out of the range of file_data and uncompressed_length.
+bool SyncPointsToSegments(const SyncPointsFileRepr &sync_points_data,
+    const CompressedFileRepr &file_data, const uint32_t uncompressed_length,
+    std::vector<BlockSegment> &segments);
+
+// Populates segments with the NUM_INTERLEAVED_STREAMS streams of file_data
+// (which belongs to a block holding uncompressed_length bytes in a file with
+// FLAG_INTERLEAVED_STREAMS).
+void InterleavedStreamsToSegments(const CompressedFileRepr &file_data,
+    const uint32_t uncompressed_length, std::vector<BlockSegment> &segments);
+
+// Decodes all the given segments of file_data at once, side by side on this thread
+// (see DecodeTable::DecodeInterleaved), writing their chars to output. Returns false if
+// any segment's bits don't decode exactly into its num_chars chars.
+bool DecompressInterleavedSegments(const DecodeTable &decode_table,
+    const CompressedFileRepr &file_data, const std::vector<BlockSegment> &segments,
+    char *output);
+
+// Decodes the given segment of file_data with decode_table, writing its chars to output
+// (which must have room for segment.num_chars chars). Segments of the same block can be decoded
+// on different threads at once. Returns false if the segment's bits don't decode exactly into
+// segment.num_chars chars.
+bool DecompressSegment(const DecodeTable &decode_table, const CompressedFileRepr &file_data,
+    const BlockSegment &segment, char *output);
+
+// Decodes file_data (the bits of a BLOCK_CONTEXT block holding num_chars chars) into output,
+// decoding each char with decode_tables[context_tables[c]], where c is the char before it
+// (see ContextMap). Returns false if the bits don't decode exactly into num_chars chars.
+bool DecompressWithContexts(const std::vector<DecodeTable> &decode_tables,
+    const ContextMap &context_tables, const CompressedFileRepr &file_data, char *output,
+    const size_t num_chars);
+
+// Decodes runs_data (the content of a BLOCK_RUNS block; see EncodeRuns) into output, which must
+// have room for num_chars chars. Returns false unless the runs add up to exactly num_chars chars.
+bool DecodeRuns(std::string_view runs_data, char *output, const size_t num_chars);
+
+// This struct represents a version 3 block, parsed for decoding: its regions, the tables that its
+// bits are decoded with, and the parts of it that can be decoded on their own (see
+// DecodeBlockPart). It views the block's content, which must outlive it.
+struct ParsedBlock {
+    BlockHeader header;
+    std::string_view content;
+    bool interleaved;                           // whether the block's bits are interleaved streams
+    CodeLengthsFileRepr code_lengths_data;      // a BLOCK_HUFFMAN block's bit sequence lengths
+    CodeLengths code_lengths;
+    uint32_t dictionary_id;                     // a BLOCK_DICTIONARY block's dictionary
+    ContextMapFileRepr context_map_data;        // a BLOCK_CONTEXT block's context map,
+    std::vector<CodeLengthsFileRepr> tables_data;   // and the lengths of each of its tables
+    CompressedFileRepr file_data;               // the block's bits (none, for raw blocks)
+    SyncPointsFileRepr sync_points_data;
+    std::shared_ptr<const DecodeTable> decode_table;    // null unless the block has one table
+    std::vector<DecodeTable> context_decode_tables;     // a BLOCK_CONTEXT block's tables
+    std::vector<BlockSegment> segments;         // the runs of the bits that decode on their own
+};
+
+// Parses block_content, the content of a block with the given header in a file with the given
+// StreamHeader flags, into block. previous_decode_table is the table of the block before (null
+// if it has none), which a BLOCK_REPEAT block reuses; it is then set to this block's table.
+// BLOCK_DICTIONARY blocks are decoded with dictionary_decode_table, the table of the dictionary
+// with ID dictionary_id (null if there is none). Returns false if the block is invalid.
+bool ParseBlock(const uint32_t stream_flags, const BlockHeader &block_header,
+    std::string_view block_content, const uint32_t dictionary_id,
+    const std::shared_ptr<const DecodeTable> &dictionary_decode_table,
+    std::shared_ptr<const DecodeTable> &previous_decode_table, ParsedBlock &block);
+
+// Returns the number of parts that block is decoded in: one per segment between sync points,
+// or else one for the whole block (whose interleaved streams are decoded together).
+size_t NumBlockParts(const ParsedBlock &block);
+
+// Decodes the given part (from 0 to NumBlockParts(block) - 1) of block into its place in output,
+// which must have room for the whole block's uncompressed_length chars. Different parts can be
+// decoded on different threads at once. Returns false unless the part decodes exactly into its
+// chars.
+bool DecodeBlockPart(const ParsedBlock &block, const size_t part, char *output);
+
+// Decodes the num_chars uncompressed bytes starting at byte first_char of file_contents (which
+// represents a version 3 compressed file) into output, which must have room for them. Blocks
+// before the range are skipped from block header to block header, and within the blocks holding
+// the range, decoding starts at the last sync point (or interleaved stream) before the range and
+// stops at its end, so only those parts of file_contents are read. BLOCK_DICTIONARY blocks are
+// decoded with dictionary_decode_table, the table of the dictionary with ID dictionary_id (null if
+// there is none). Block checksums aren't checked, since that would read all of each block.
+// Returns false if the range goes past the end of the file, or a block it needs is invalid.
+bool DecompressRange(std::string_view file_contents, const uint64_t first_char,
+    const size_t num_chars, const uint32_t dictionary_id,
+    const DecodeTable *dictionary_decode_table, char *output);
+
+// Decodes all of file_contents (which represents a version 3 compressed file, or an empty one)
+// into output, which must have room for exactly num_chars chars: the file's uncompressed size
+// (see ScanUncompressedSize). Each block is decoded straight into its place in output, so
+// a caller with its own buffer decompresses without allocating one. Unlike DecompressRange,
+// each block's checksum is checked. Blocks are decoded with DecodeBlockPart, as huffman -d does,
+// so each must decode into exactly its length from exactly its bits. Returns false if num_chars
+// isn't the file's uncompressed size, or a block is invalid.
+bool DecompressFile(std::string_view file_contents, const uint32_t dictionary_id,
+    const DecodeTable *dictionary_decode_table, char *output, const size_t num_chars);
+// Same as above, but sizes output to the file's uncompressed size once, and decodes into it.
+bool DecompressFile(std::string_view file_contents, const uint32_t dictionary_id,
+    const DecodeTable *dictionary_decode_table, std::string &output);
+
+// Populates code_lengths with the bit sequence length of each char in code_lengths_repr.
+// Returns false if code_lengths_repr does not describe a valid (complete) code.
+bool CodeLengthsReprToCodeLengths(const CodeLengthsFileRepr &code_lengths_repr,
+    CodeLengths &code_lengths);
+
 // Reconstructs the uncompressed contents of the given file_data.compressed_bits,
-// using the given tree for mapping bits to characters.
+// using a DecodeTable built from the given tree for mapping bits to characters.
 // Returns the contents of the decompressed file as a string.
 std::string DecompressFile(const huffman::TreeNode &root, const CompressedFileRepr &file_data);
+// Reconstructs the uncompressed contents of the given file_data.compressed_bits,
+// using a DecodeTable built from the given canonical bit sequence lengths.
+// Returns the contents of the decompressed file as a string.
+std::string DecompressFile(const CodeLengths &code_lengths, const CompressedFileRepr &file_data);
 
 }  // namespace huffman
 
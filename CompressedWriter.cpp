@@ -1,21 +1,29 @@
+#include <algorithm>
 #include <cstring>
+#include <initializer_list>
 #include <string>
 #include <sstream>
 #include "CompressedWriter.h"
 
 namespace huffman {
 
-#define CHARS_PER_CHECKSUM_ELEM 8
-
 void BuildTreeFileRepr(const TreeNode &current_node, int16_t &node_count,
     std::stringstream &current_characters, int16_t &special_leaf_index);
 
+std::string BuildFileWithHeader(const uint32_t magic_number, const std::string &file_content);
+
+std::string BuildBlockWithContent(const uint8_t block_type,
+    std::initializer_list<std::string_view> content_parts, const uint32_t uncompressed_length,
+    const uint32_t stream_flags);
+
+std::string DictionaryIdToBytes(const uint32_t dictionary_id);
+
 std::string TreeFileRepr::ToBytes() const {
     char number_buffer[TreeFileRepr::MetadataSize()];
     memcpy(number_buffer, &num_nodes, sizeof(num_nodes));
     memcpy(number_buffer + sizeof(num_nodes), &special_leaf_index, sizeof(special_leaf_index));
 
-    return std::string(number_buffer, TreeFileRepr::MetadataSize()) + tree_data;
+    return std::string(number_buffer, TreeFileRepr::MetadataSize()).append(tree_data);
 }
 
 TreeFileRepr TreeToFileRepr(const TreeNode &root) {
@@ -24,10 +32,12 @@ TreeFileRepr TreeToFileRepr(const TreeNode &root) {
     int16_t special_leaf_index = -1;
     BuildTreeFileRepr(root, node_count, characters_builder, special_leaf_index);
 
+    auto tree_data = std::make_shared<const std::string>(characters_builder.str());
     return {
         node_count,
         special_leaf_index,
-        characters_builder.str()
+        *tree_data,
+        tree_data
     };
 }
 
@@ -51,28 +61,283 @@ void BuildTreeFileRepr(const TreeNode &current_node, int16_t &node_count,
     node_count++;
 }
 
+std::string CodeLengthsFileRepr::ToBytes() const {
+    char number_buffer[CodeLengthsFileRepr::MetadataSize()];
+    memcpy(number_buffer, &num_chars, sizeof(num_chars));
+    memcpy(number_buffer + sizeof(num_chars), &max_length, sizeof(max_length));
+
+    return std::string(number_buffer, CodeLengthsFileRepr::MetadataSize()) + length_counts + chars;
+}
+
+CodeLengthsFileRepr CodeLengthsToFileRepr(const CodeLengths &code_lengths) {
+    std::vector<unsigned char> order = CanonicalOrder(code_lengths);
+    uint8_t max_length = order.empty() ? 0 : code_lengths[order.back()];
+
+    std::string length_counts(max_length > 0 ? max_length - 1 : 0, '\0');
+    for (const unsigned char c : order) {
+        if (code_lengths[c] < max_length) {
+            length_counts[code_lengths[c] - 1]++;
+        }
+    }
+
+    return {
+        static_cast<uint16_t>(order.size()),
+        max_length,
+        length_counts,
+        std::string(order.begin(), order.end())
+    };
+}
+
+std::string ContextMapFileRepr::ToBytes() const {
+    std::string bytes(1, static_cast<char>(num_tables));
+    return bytes.append(context_tables.begin(), context_tables.end());
+}
+
 std::string CompressedFileRepr::ToBytes() const {
     char number_buffer[CompressedFileRepr::MetadataSize()];
     memcpy(number_buffer, &num_bits, sizeof(num_bits));
 
-    return std::string(number_buffer, CompressedFileRepr::MetadataSize()) + compressed_bits;
+    std::string bytes(number_buffer, CompressedFileRepr::MetadataSize());
+    for (const uint64_t stream_bits : stream_num_bits) {
+        bytes.append(reinterpret_cast<const char *>(&stream_bits), sizeof(stream_bits));
+    }
+    return bytes.append(compressed_bits);
+}
+
+std::string SyncPointsFileRepr::ToBytes() const {
+    std::string bytes(SyncPointsFileRepr::MetadataSize() + points.size() * PointSize(), '\0');
+    char *next = &bytes[0];
+    memcpy(next, &num_points, sizeof(num_points));
+    next += sizeof(num_points);
+    for (const SyncPoint &point : points) {
+        memcpy(next, &point.bit_offset, sizeof(point.bit_offset));
+        next += sizeof(point.bit_offset);
+        memcpy(next, &point.byte_offset, sizeof(point.byte_offset));
+        next += sizeof(point.byte_offset);
+    }
+    return bytes;
+}
+
+// Appends the bit sequences of the chars from next to end to compressed_builder, putting
+// CHARS_PER_FLUSH chars into the register between flushes. All the bit sequences in encode_table
+// must fit CHARS_PER_FLUSH times into MAX_BITS_PER_FLUSH bits.
+template <int CHARS_PER_FLUSH>
+void EncodeChars(const EncodeTable &encode_table, const unsigned char *next,
+    const unsigned char *end, BitWriter &compressed_builder) {
+    for (; end - next >= CHARS_PER_FLUSH; next += CHARS_PER_FLUSH) {
+        for (int i = 0; i < CHARS_PER_FLUSH; i++) {
+            const EncodeEntry &entry = encode_table[next[i]];
+            compressed_builder.PutBits(entry.code, entry.length);
+        }
+        compressed_builder.FlushBytes();
+    }
+    for (; next != end; next++) {
+        compressed_builder.AppendBits(encode_table[*next].code, encode_table[*next].length);
+    }
+}
+
+// Appends the bit sequences of the chars from next to end to compressed_builder, putting as many
+// chars into the register between flushes as max_length (the longest sequence) allows.
+void EncodeBytes(const EncodeTable &encode_table, const int max_length,
+    const unsigned char *next, const unsigned char *end, BitWriter &compressed_builder) {
+    if (4 * max_length <= MAX_BITS_PER_FLUSH) {
+        EncodeChars<4>(encode_table, next, end, compressed_builder);
+    } else if (3 * max_length <= MAX_BITS_PER_FLUSH) {
+        EncodeChars<3>(encode_table, next, end, compressed_builder);
+    } else if (2 * max_length <= MAX_BITS_PER_FLUSH) {
+        EncodeChars<2>(encode_table, next, end, compressed_builder);
+    } else {
+        for (; next != end; next++) {
+            compressed_builder.AppendBits(encode_table[*next].code, encode_table[*next].length);
+        }
+    }
+}
+
+CompressedFileRepr CompressFileBytes(const EncodeTable &encode_table,
+    std::string_view file_bytes) {
+    SyncPointsFileRepr sync_points;
+    return CompressFileBytes(encode_table, file_bytes, 0, sync_points);
 }
 
-CompressedFileRepr CompressFileBytes(
-    const std::unordered_map<unsigned char, std::unique_ptr<Bits>> &char_to_bits,
-    const std::string &file_bytes) {
+CompressedFileRepr CompressFileBytes(const EncodeTable &encode_table,
+    std::string_view file_bytes, const size_t sync_interval, SyncPointsFileRepr &sync_points) {
+    int max_length = 0;
+    for (const EncodeEntry &entry : encode_table) {
+        max_length = std::max(max_length, entry.length);
+    }
+
+    const unsigned char *start = reinterpret_cast<const unsigned char *>(file_bytes.data());
+    const unsigned char *end = start + file_bytes.size();
+    const size_t segment_length = sync_interval != 0 ? sync_interval : file_bytes.size();
 
-    huffman::BitWriter compressed_builder;
-    for (const unsigned char b : file_bytes) {
-        compressed_builder.AppendBits(*char_to_bits.at(b));
+    huffman::BitWriter compressed_builder(file_bytes.size());
+    sync_points.points.clear();
+    for (const unsigned char *next = start; next != end;) {
+        if (next != start) {
+            sync_points.points.push_back({
+                compressed_builder.GetTotalNumBits(),
+                static_cast<uint32_t>(next - start)
+            });
+        }
+        const unsigned char *segment_end
+            = next + std::min<size_t>(segment_length, end - next);
+        EncodeBytes(encode_table, max_length, next, segment_end, compressed_builder);
+        next = segment_end;
     }
+    sync_points.num_points = sync_points.points.size();
 
+    uint64_t num_bits = compressed_builder.GetTotalNumBits();
+    auto compressed_bits = std::make_shared<const std::string>(compressed_builder.TakeBytes());
     return {
-        compressed_builder.GetTotalNumBits(),
-        compressed_builder.ToBytes()
+        num_bits,
+        *compressed_bits,
+        compressed_bits,
+        { }     // the bits are one stream
     };
 }
 
+CompressedFileRepr CompressFileBytesInterleaved(const EncodeTable &encode_table,
+    std::string_view file_bytes) {
+    int max_length = 0;
+    for (const EncodeEntry &entry : encode_table) {
+        max_length = std::max(max_length, entry.length);
+    }
+
+    const unsigned char *start = reinterpret_cast<const unsigned char *>(file_bytes.data());
+    const size_t stream_length = InterleavedStreamLength(file_bytes.size());
+
+    huffman::BitWriter compressed_builder(file_bytes.size());
+    std::vector<uint64_t> stream_num_bits;
+    uint64_t num_bits = 0;
+    for (int i = 0; i < NUM_INTERLEAVED_STREAMS; i++) {
+        size_t stream_start = std::min(file_bytes.size(), i * stream_length);
+        size_t stream_end = i + 1 == NUM_INTERLEAVED_STREAMS
+            ? file_bytes.size() : std::min(file_bytes.size(), (i + 1) * stream_length);
+        uint64_t stream_start_bit = compressed_builder.GetTotalNumBits();
+        EncodeBytes(encode_table, max_length, start + stream_start, start + stream_end,
+            compressed_builder);
+        uint64_t stream_bits = compressed_builder.GetTotalNumBits() - stream_start_bit;
+        num_bits += stream_bits;
+
+        // the next stream starts on a byte boundary; the padding isn't part of any stream
+        if (i + 1 != NUM_INTERLEAVED_STREAMS) {
+            stream_num_bits.push_back(stream_bits);
+            compressed_builder.AppendBits(0, (BITS_PER_ELEM - stream_bits % BITS_PER_ELEM)
+                % BITS_PER_ELEM);
+        }
+    }
+
+    auto compressed_bits = std::make_shared<const std::string>(compressed_builder.TakeBytes());
+    return {
+        num_bits,
+        *compressed_bits,
+        compressed_bits,
+        stream_num_bits
+    };
+}
+
+// Same as EncodeChars, but each char's bit sequence comes from the table of the char before it
+// (starting from the char before next, previous).
+template <int CHARS_PER_FLUSH>
+void EncodeCharsWithContexts(const EncodeTable *const *context_encode_tables,
+    unsigned char previous, const unsigned char *next, const unsigned char *end,
+    BitWriter &compressed_builder) {
+    for (; end - next >= CHARS_PER_FLUSH; next += CHARS_PER_FLUSH) {
+        for (int i = 0; i < CHARS_PER_FLUSH; i++) {
+            const EncodeEntry &entry = (*context_encode_tables[previous])[next[i]];
+            compressed_builder.PutBits(entry.code, entry.length);
+            previous = next[i];
+        }
+        compressed_builder.FlushBytes();
+    }
+    for (; next != end; next++) {
+        const EncodeEntry &entry = (*context_encode_tables[previous])[*next];
+        compressed_builder.AppendBits(entry.code, entry.length);
+        previous = *next;
+    }
+}
+
+CompressedFileRepr CompressFileBytesWithContexts(const std::vector<EncodeTable> &encode_tables,
+    const ContextMap &context_tables, std::string_view file_bytes) {
+    int max_length = 0;
+    for (const EncodeTable &encode_table : encode_tables) {
+        for (const EncodeEntry &entry : encode_table) {
+            max_length = std::max(max_length, entry.length);
+        }
+    }
+    // each context's table is looked up directly, instead of through its index
+    const EncodeTable *context_encode_tables[NUM_CHARS];
+    for (int c = 0; c < NUM_CHARS; c++) {
+        context_encode_tables[c] = &encode_tables[context_tables[c]];
+    }
+
+    const unsigned char *start = reinterpret_cast<const unsigned char *>(file_bytes.data());
+    const unsigned char *end = start + file_bytes.size();
+    huffman::BitWriter compressed_builder(file_bytes.size());
+    if (4 * max_length <= MAX_BITS_PER_FLUSH) {
+        EncodeCharsWithContexts<4>(context_encode_tables, 0, start, end, compressed_builder);
+    } else if (2 * max_length <= MAX_BITS_PER_FLUSH) {
+        EncodeCharsWithContexts<2>(context_encode_tables, 0, start, end, compressed_builder);
+    } else {
+        unsigned char previous = 0;
+        for (const unsigned char *next = start; next != end; next++) {
+            const EncodeEntry &entry = (*context_encode_tables[previous])[*next];
+            compressed_builder.AppendBits(entry.code, entry.length);
+            previous = *next;
+        }
+    }
+
+    uint64_t num_bits = compressed_builder.GetTotalNumBits();
+    auto compressed_bits = std::make_shared<const std::string>(compressed_builder.TakeBytes());
+    return {
+        num_bits,
+        *compressed_bits,
+        compressed_bits,
+        { }     // the bits are one stream
+    };
+}
+
+std::string EncodeRuns(std::string_view file_bytes) {
+    std::string runs_data;
+    for (size_t run_start = 0; run_start < file_bytes.size();) {
+        size_t run_end = run_start + 1;
+        while (run_end < file_bytes.size() && file_bytes[run_end] == file_bytes[run_start]) {
+            run_end++;
+        }
+        runs_data.push_back(file_bytes[run_start]);
+        for (size_t run_length = run_end - run_start;; run_length >>= 7) {
+            if (run_length < 0x80) {
+                runs_data.push_back(static_cast<char>(run_length));
+                break;
+            }
+            runs_data.push_back(static_cast<char>(0x80 | (run_length & 0x7f)));
+        }
+        run_start = run_end;
+    }
+    return runs_data;
+}
+
+size_t EncodedRunsSize(std::string_view file_bytes, const size_t limit) {
+    size_t size = 0;
+    for (size_t run_start = 0; run_start < file_bytes.size() && size <= limit;) {
+        size_t run_end = run_start + 1;
+        while (run_end < file_bytes.size() && file_bytes[run_end] == file_bytes[run_start]) {
+            run_end++;
+        }
+        // the byte, then 7 bits of the length per byte
+        size += 2;
+        for (size_t run_length = (run_end - run_start) >> 7; run_length != 0; run_length >>= 7) {
+            size++;
+        }
+        run_start = run_end;
+    }
+    return size;
+}
+
+size_t InterleavedStreamLength(const size_t uncompressed_length) {
+    return (uncompressed_length + NUM_INTERLEAVED_STREAMS - 1) / NUM_INTERLEAVED_STREAMS;
+}
+
 std::string FileHeader::ToBytes() const {
     char number_buffer[FileHeader::MetadataSize()];
     memcpy(number_buffer, &magic_number, sizeof(magic_number));
@@ -82,28 +347,186 @@ std::string FileHeader::ToBytes() const {
     return std::string(number_buffer, FileHeader::MetadataSize());
 }
 
-uint32_t ComputeChecksum(const std::string &data) {
-    uint32_t aggregate_hash_number = 0;
-    uint32_t current_hash_number = 1;
-    for (size_t i = 0; i < data.length(); i++) {
-        const unsigned char c = data.at(i);
-        current_hash_number = 31 * current_hash_number + c;
-        if ((i + 1) % CHARS_PER_CHECKSUM_ELEM == 0) {
-            aggregate_hash_number ^= current_hash_number;
-            current_hash_number = 1;
-        }
-    }
-    aggregate_hash_number ^= current_hash_number;
-    return aggregate_hash_number;
+std::string StreamHeader::ToBytes() const {
+    char number_buffer[StreamHeader::MetadataSize()];
+    memcpy(number_buffer, &magic_number, sizeof(magic_number));
+    memcpy(number_buffer + sizeof(magic_number), &block_size, sizeof(block_size));
+    memcpy(number_buffer + sizeof(magic_number) + sizeof(block_size), &flags, sizeof(flags));
+    return std::string(number_buffer, StreamHeader::MetadataSize());
+}
+
+std::string BlockHeader::ToBytes() const {
+    char number_buffer[BlockHeader::MetadataSize()];
+    char *next = number_buffer;
+    memcpy(next, &block_type, sizeof(block_type));
+    next += sizeof(block_type);
+    memcpy(next, &checksum, sizeof(checksum));
+    next += sizeof(checksum);
+    memcpy(next, &uncompressed_length, sizeof(uncompressed_length));
+    next += sizeof(uncompressed_length);
+    memcpy(next, &content_length, sizeof(content_length));
+    return std::string(number_buffer, BlockHeader::MetadataSize());
+}
+
+std::string DictionaryHeader::ToBytes() const {
+    char number_buffer[DictionaryHeader::MetadataSize()];
+    memcpy(number_buffer, &magic_number, sizeof(magic_number));
+    memcpy(number_buffer + sizeof(magic_number), &dictionary_id, sizeof(dictionary_id));
+    return std::string(number_buffer, DictionaryHeader::MetadataSize());
+}
+
+uint32_t ComputeDictionaryId(const CodeLengthsFileRepr &code_lengths_data) {
+    return ComputeChecksum(code_lengths_data.ToBytes(), CHECKSUM_CRC32C);
+}
+
+uint32_t ComputeChecksum(std::string_view data, const int checksum_type) {
+    Checksum checksum(checksum_type);
+    checksum.Update(data);
+    return checksum.GetValue();
+}
+
+int BlockChecksumType(const uint32_t stream_flags) {
+    return (stream_flags & FLAG_CRC32C) ? CHECKSUM_CRC32C : CHECKSUM_SIMPLE;
 }
 
 std::string BuildFile(const huffman::TreeFileRepr &tree_data,
     huffman::CompressedFileRepr &file_data) {
-    std::string file_content = tree_data.ToBytes() + file_data.ToBytes();
-    uint32_t checksum = ComputeChecksum(file_content);
+    return BuildFileWithHeader(MAGIC_NUMBER_V1, tree_data.ToBytes() + file_data.ToBytes());
+}
+
+std::string BuildFile(const huffman::CodeLengthsFileRepr &code_lengths_data,
+    huffman::CompressedFileRepr &file_data) {
+    return BuildFileWithHeader(MAGIC_NUMBER_V2, code_lengths_data.ToBytes() + file_data.ToBytes());
+}
+
+std::string BuildStreamHeader(const uint32_t block_size, const uint32_t flags) {
+    StreamHeader header = {
+        MAGIC_NUMBER_V3,
+        block_size,
+        flags
+    };
+    return header.ToBytes();
+}
+
+std::string BuildBlock(const huffman::CodeLengthsFileRepr &code_lengths_data,
+    huffman::CompressedFileRepr &file_data, const uint32_t uncompressed_length,
+    const uint32_t stream_flags) {
+    return BuildBlockWithContent(BLOCK_HUFFMAN,
+        { code_lengths_data.ToBytes(), file_data.ToBytes() }, uncompressed_length, stream_flags);
+}
+
+std::string BuildBlock(const huffman::CodeLengthsFileRepr &code_lengths_data,
+    huffman::CompressedFileRepr &file_data, const huffman::SyncPointsFileRepr &sync_points_data,
+    const uint32_t uncompressed_length, const uint32_t stream_flags) {
+    return BuildBlockWithContent(BLOCK_HUFFMAN,
+        { code_lengths_data.ToBytes(), file_data.ToBytes(), sync_points_data.ToBytes() },
+        uncompressed_length, stream_flags);
+}
+
+std::string BuildBlock(const uint32_t dictionary_id, huffman::CompressedFileRepr &file_data,
+    const uint32_t uncompressed_length, const uint32_t stream_flags) {
+    return BuildBlockWithContent(BLOCK_DICTIONARY,
+        { DictionaryIdToBytes(dictionary_id), file_data.ToBytes() }, uncompressed_length,
+        stream_flags);
+}
+
+std::string BuildBlock(const uint32_t dictionary_id, huffman::CompressedFileRepr &file_data,
+    const huffman::SyncPointsFileRepr &sync_points_data, const uint32_t uncompressed_length,
+    const uint32_t stream_flags) {
+    return BuildBlockWithContent(BLOCK_DICTIONARY,
+        { DictionaryIdToBytes(dictionary_id), file_data.ToBytes(), sync_points_data.ToBytes() },
+        uncompressed_length, stream_flags);
+}
+
+std::string BuildRepeatBlock(huffman::CompressedFileRepr &file_data,
+    const uint32_t uncompressed_length, const uint32_t stream_flags) {
+    return BuildBlockWithContent(BLOCK_REPEAT, { file_data.ToBytes() }, uncompressed_length,
+        stream_flags);
+}
+
+std::string BuildRepeatBlock(huffman::CompressedFileRepr &file_data,
+    const huffman::SyncPointsFileRepr &sync_points_data, const uint32_t uncompressed_length,
+    const uint32_t stream_flags) {
+    return BuildBlockWithContent(BLOCK_REPEAT, { file_data.ToBytes(), sync_points_data.ToBytes() },
+        uncompressed_length, stream_flags);
+}
+
+std::string BuildContextBlock(const ContextMapFileRepr &context_map_data,
+    const std::vector<CodeLengthsFileRepr> &tables_data, CompressedFileRepr &file_data,
+    const uint32_t uncompressed_length, const uint32_t stream_flags) {
+    std::string tables_bytes;
+    for (const CodeLengthsFileRepr &table_data : tables_data) {
+        tables_bytes += table_data.ToBytes();
+    }
+    return BuildBlockWithContent(BLOCK_CONTEXT,
+        { context_map_data.ToBytes(), tables_bytes, file_data.ToBytes() }, uncompressed_length,
+        stream_flags);
+}
+
+std::string BuildStoredBlock(std::string_view file_bytes, const uint32_t stream_flags) {
+    return BuildBlockWithContent(BLOCK_STORED, { file_bytes }, file_bytes.size(), stream_flags);
+}
+
+std::string BuildRunsBlock(std::string_view runs_data, const uint32_t uncompressed_length,
+    const uint32_t stream_flags) {
+    return BuildBlockWithContent(BLOCK_RUNS, { runs_data }, uncompressed_length, stream_flags);
+}
+
+std::string DictionaryIdToBytes(const uint32_t dictionary_id) {
+    char number_buffer[sizeof(dictionary_id)];
+    memcpy(number_buffer, &dictionary_id, sizeof(dictionary_id));
+    return std::string(number_buffer, sizeof(dictionary_id));
+}
+
+std::string BuildBlockWithContent(const uint8_t block_type,
+    std::initializer_list<std::string_view> content_parts, const uint32_t uncompressed_length,
+    const uint32_t stream_flags) {
+    // the checksum is taken part by part, so the content is only copied once, into the block
+    Checksum checksum(BlockChecksumType(stream_flags));
+    size_t content_length = 0;
+    for (std::string_view part : content_parts) {
+        checksum.Update(part);
+        content_length += part.size();
+    }
+
+    BlockHeader header = {
+        block_type,
+        checksum.GetValue(),
+        uncompressed_length,
+        static_cast<uint32_t>(content_length)
+    };
+
+    std::string block = header.ToBytes();
+    block.reserve(block.size() + content_length);
+    for (std::string_view part : content_parts) {
+        block.append(part);
+    }
+    return block;
+}
+
+std::string BuildEndBlock(const uint32_t stream_flags) {
+    BlockHeader header = {
+        BLOCK_END,
+        ComputeChecksum("", BlockChecksumType(stream_flags)),
+        0,
+        0
+    };
+    return header.ToBytes();
+}
+
+std::string BuildDictionary(const CodeLengthsFileRepr &code_lengths_data) {
+    DictionaryHeader header = {
+        MAGIC_NUMBER_DICT,
+        ComputeDictionaryId(code_lengths_data)
+    };
+    return header.ToBytes() + code_lengths_data.ToBytes();
+}
+
+std::string BuildFileWithHeader(const uint32_t magic_number, const std::string &file_content) {
+    uint32_t checksum = ComputeChecksum(file_content, CHECKSUM_SIMPLE);
 
     FileHeader header = {
-        MAGIC_NUMBER,
+        magic_number,
         checksum,
         file_content.size()
     };
@@ -2,19 +2,63 @@
 #define _COMPRESSEDWRITER_H_
 
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "TreeNode.h"
+#include "CanonicalCode.h"
+#include "Checksum.h"
 
 namespace huffman {
 
 #define PARENT_CHAR '\0'
-#define MAGIC_NUMBER 0xcafef00d
+#define MAGIC_NUMBER_V1 0xcafef00d   // files whose FileHeader is followed by a TreeFileRepr
+#define MAGIC_NUMBER_V2 0xcafef002   // files whose FileHeader is followed by a CodeLengthsFileRepr
+#define MAGIC_NUMBER_V3 0xcafef003   // files made of a StreamHeader followed by blocks
+#define MAGIC_NUMBER MAGIC_NUMBER_V3 // the version written by the compressor
+#define MAGIC_NUMBER_DICT 0xcafef0d1 // dictionary files (see DictionaryHeader)
+
+#define DEFAULT_BLOCK_SIZE (1 << 20)
+#define MAX_BLOCK_SIZE (1 << 26)
+
+#define BLOCK_END 0         // marks the end of the stream; has no content
+#define BLOCK_HUFFMAN 1     // content is a CodeLengthsFileRepr followed by a CompressedFileRepr
+                            // (and a SyncPointsFileRepr, with FLAG_SYNC_POINTS)
+#define BLOCK_DICTIONARY 2  // same as BLOCK_HUFFMAN, but with the dictionary_id of a dictionary
+                            // (whose bit sequences the block uses) instead of a CodeLengthsFileRepr
+#define BLOCK_REPEAT 3      // same as BLOCK_HUFFMAN, but without a CodeLengthsFileRepr: the block
+                            // uses the same bit sequences as the block before it
+#define BLOCK_CONTEXT 4     // content is a ContextMapFileRepr, the CodeLengthsFileRepr of each of
+                            // its tables, then a CompressedFileRepr whose bits are one stream
+                            // without sync points, whatever the stream's flags
+#define BLOCK_STORED 5      // content is the block's uncompressed bytes, as they are
+#define BLOCK_RUNS 6        // content is the block's uncompressed bytes as runs of one byte
+                            // (see EncodeRuns)
+
+#define FLAG_SYNC_POINTS 0x1            // BLOCK_HUFFMAN content ends with a SyncPointsFileRepr
+#define FLAG_INTERLEAVED_STREAMS 0x2    // BLOCK_HUFFMAN compressed bits are split into streams
+#define FLAG_CRC32C 0x4                 // blocks' checksums are CRC32C instead of CHECKSUM_SIMPLE
+#define SUPPORTED_FLAGS (FLAG_SYNC_POINTS | FLAG_INTERLEAVED_STREAMS | FLAG_CRC32C)
+
+#define NUM_INTERLEAVED_STREAMS 4
+
+#define MIN_SYNC_INTERVAL (1 << 12)
+
+#define MAX_CONTEXT_TABLES 16
+
+// The index of the table of bit sequences that each char is compressed with in a BLOCK_CONTEXT
+// block, indexed by the char before it (its context). The first char of a block has context 0.
+typedef std::array<uint8_t, NUM_CHARS> ContextMap;
 
 // This struct represents how the tree mapping bits to bytes is represented in the compressed file.
+// tree_data either points into storage or, when read from a compressed file, into the buffer
+// holding that file (which must then outlive this TreeFileRepr).
 struct TreeFileRepr {
     int16_t num_nodes;          // the number of nodes in the tree
     int16_t special_leaf_index; // index to tell apart a parent node and a PARENT_CHAR leaf node
-    std::string tree_data;      // bytes representing the tree
+    std::string_view tree_data; // bytes representing the tree
+    std::shared_ptr<const std::string> storage;     // owns tree_data's bytes, if anything does
 
     // Returns the number of bytes that the metadata of a TreeFileRepr takes up in ToBytes().
     static size_t MetadataSize() { return sizeof(num_nodes) + sizeof(special_leaf_index); }
@@ -26,11 +70,49 @@ struct TreeFileRepr {
 // Constructs a TreeFileRepr that represents the given tree. 
 TreeFileRepr TreeToFileRepr(const TreeNode &root);
 
+// This struct represents how the lengths of the canonical bit sequences of each char
+// are represented in the compressed file (the bit sequences themselves follow from the lengths).
+struct CodeLengthsFileRepr {
+    uint16_t num_chars;         // the number of chars that have a bit sequence
+    uint8_t max_length;         // the length of the longest bit sequence
+    std::string length_counts;  // for lengths 1 to max_length - 1, the number of chars of that
+                                // length (the count for max_length is whatever chars remain)
+    std::string chars;          // the chars with a bit sequence, in CanonicalOrder
+
+    // Returns the number of bytes that the metadata of a CodeLengthsFileRepr takes up in ToBytes().
+    static size_t MetadataSize() { return sizeof(num_chars) + sizeof(max_length); }
+
+    // Returns what the bytes of this CodeLengthsFileRepr will be in the compressed file.
+    std::string ToBytes() const;
+};
+
+// Constructs a CodeLengthsFileRepr that represents the given bit sequence lengths.
+CodeLengthsFileRepr CodeLengthsToFileRepr(const CodeLengths &code_lengths);
+
+// This struct represents how a BLOCK_CONTEXT block's contexts are mapped to its tables
+// in the compressed file.
+struct ContextMapFileRepr {
+    uint8_t num_tables;         // the number of tables, from 1 to MAX_CONTEXT_TABLES
+    ContextMap context_tables;  // the table of each context (unused contexts have table 0)
+
+    // Returns the number of bytes that a ContextMapFileRepr takes up in ToBytes().
+    static size_t MetadataSize() { return sizeof(num_tables) + NUM_CHARS; }
+
+    // Returns what the bytes of this ContextMapFileRepr will be in the compressed file.
+    std::string ToBytes() const;
+};
+
 // This struct represents how the compressed data (not including the tree or header)
-// is represented in the compressed file.
+// is represented in the compressed file. Like TreeFileRepr::tree_data, compressed_bits either
+// points into storage or into the buffer holding the compressed file.
+// With FLAG_INTERLEAVED_STREAMS, compressed_bits is made of NUM_INTERLEAVED_STREAMS streams that
+// each start on a byte boundary, and stream_num_bits gives the length of every stream but the
+// last (which takes up the rest of num_bits).
 struct CompressedFileRepr {
-    uint64_t num_bits;              // the number of bits that the compressed file data takes up
-    std::string compressed_bits;    // the file's compressed data
+    uint64_t num_bits;                  // the number of bits that the compressed file data takes up
+    std::string_view compressed_bits;   // the file's compressed data
+    std::shared_ptr<const std::string> storage;     // owns compressed_bits' bytes, if anything does
+    std::vector<uint64_t> stream_num_bits;          // how many bits each stream but the last has
 
     // Returns the number of bytes that the metadata of a CompressedFileRepr takes up in ToBytes().
     static size_t MetadataSize() { return sizeof(num_bits); }
@@ -39,11 +121,60 @@ struct CompressedFileRepr {
     std::string ToBytes() const;
 };
 
+// This struct represents a place in the compressed data where decoding can start over,
+// so that the data on either side of it can be decoded separately.
+struct SyncPoint {
+    uint64_t bit_offset;    // the number of compressed bits before this point
+    uint32_t byte_offset;   // the number of uncompressed bytes before this point
+};
+
+// This struct represents how the sync points of a block's compressed data are represented
+// in the compressed file.
+struct SyncPointsFileRepr {
+    uint32_t num_points;                // the number of sync points
+    std::vector<SyncPoint> points;      // the sync points, in increasing order
+
+    // Returns the number of bytes that the metadata of a SyncPointsFileRepr takes up in ToBytes().
+    static size_t MetadataSize() { return sizeof(num_points); }
+    // Returns the number of bytes that each sync point takes up in ToBytes().
+    static size_t PointSize() {
+        return sizeof(SyncPoint::bit_offset) + sizeof(SyncPoint::byte_offset);
+    }
+
+    // Returns what the bytes of this SyncPointsFileRepr will be in the compressed file.
+    std::string ToBytes() const;
+};
+
 // Constructs a CompressedFileRepr based on the given uncompressed data (file_to_bytes)
-// and a mapping of different bytes to bit sequences.
-CompressedFileRepr CompressFileBytes(
-    const std::unordered_map<unsigned char, std::unique_ptr<Bits>> &char_to_bits,
-    const std::string &file_bytes);
+// and a table mapping each byte to its bit sequence.
+CompressedFileRepr CompressFileBytes(const EncodeTable &encode_table,
+    std::string_view file_bytes);
+// Same as above, but also populates sync_points with a sync point after every sync_interval
+// uncompressed bytes (or with none, if sync_interval is 0).
+CompressedFileRepr CompressFileBytes(const EncodeTable &encode_table,
+    std::string_view file_bytes, const size_t sync_interval, SyncPointsFileRepr &sync_points);
+// Same as the first overload, but splits file_bytes into NUM_INTERLEAVED_STREAMS parts
+// (see InterleavedStreamLength) and compresses each into its own stream, for files with
+// FLAG_INTERLEAVED_STREAMS. The streams can then be decoded side by side.
+CompressedFileRepr CompressFileBytesInterleaved(const EncodeTable &encode_table,
+    std::string_view file_bytes);
+
+// Same as the first overload, but compresses each byte with the table that context_tables maps
+// the byte before it to (see ContextMap), for BLOCK_CONTEXT blocks.
+CompressedFileRepr CompressFileBytesWithContexts(const std::vector<EncodeTable> &encode_tables,
+    const ContextMap &context_tables, std::string_view file_bytes);
+
+// Returns file_bytes as runs of one byte, for BLOCK_RUNS blocks: each longest run of the same
+// byte is written as the byte, followed by the run's length 7 bits at a time (lowest first),
+// with the top bit of each of those bytes set if more of them follow.
+std::string EncodeRuns(std::string_view file_bytes);
+// Returns the number of bytes that EncodeRuns(file_bytes) returns, or some number over limit
+// if that's over limit (so that counting can stop early).
+size_t EncodedRunsSize(std::string_view file_bytes, const size_t limit);
+
+// Returns the number of uncompressed chars in each interleaved stream but the last, for a block
+// that holds uncompressed_length chars. The last stream holds the chars that remain.
+size_t InterleavedStreamLength(const size_t uncompressed_length);
 
 // This struct represents how the file header is represented in the compressed file.
 struct FileHeader {
@@ -58,11 +189,115 @@ struct FileHeader {
     std::string ToBytes() const;
 };
 
-// Calculates a (simple) checksum based on the contents of the given string.
-uint32_t ComputeChecksum(const std::string &data);
+// This struct represents the start of a (version 3) compressed file, which is followed by blocks
+// that each hold up to block_size bytes of the uncompressed file.
+struct StreamHeader {
+    uint32_t magic_number;      // to quickly tell if things went wrong writing/reading the file
+    uint32_t block_size;        // the most uncompressed bytes that a block holds
+    uint32_t flags;             // optional features used by the blocks (FLAG_SYNC_POINTS, ...)
+
+    // Returns the number of bytes that the metadata of a StreamHeader takes up in ToBytes().
+    static size_t MetadataSize() { return sizeof(StreamHeader); }
+
+    // Returns what the bytes of this StreamHeader will be in the compressed file.
+    std::string ToBytes() const;
+};
+
+// This struct represents the start of each block in a (version 3) compressed file.
+struct BlockHeader {
+    uint8_t block_type;             // how the block's content is represented (BLOCK_HUFFMAN, ...)
+    uint32_t checksum;              // a calculated value to match with the block's content
+    uint32_t uncompressed_length;   // the number of uncompressed bytes the block holds
+    uint32_t content_length;        // the length, in bytes, of the block's content
+
+    // Returns the number of bytes that the metadata of a BlockHeader takes up in ToBytes().
+    static size_t MetadataSize() {
+        return sizeof(block_type) + sizeof(checksum) + sizeof(uncompressed_length)
+            + sizeof(content_length);
+    }
+
+    // Returns what the bytes of this BlockHeader will be in the compressed file.
+    std::string ToBytes() const;
+};
+
+// This struct represents the start of a dictionary file, which is followed by the
+// CodeLengthsFileRepr of the bit sequences that BLOCK_DICTIONARY blocks made with it use.
+struct DictionaryHeader {
+    uint32_t magic_number;      // to quickly tell if things went wrong writing/reading the file
+    uint32_t dictionary_id;     // identifies the dictionary to the blocks that use it
+
+    // Returns the number of bytes that the metadata of a DictionaryHeader takes up in ToBytes().
+    static size_t MetadataSize() { return sizeof(DictionaryHeader); }
+
+    // Returns what the bytes of this DictionaryHeader will be in the dictionary file.
+    std::string ToBytes() const;
+};
+
+// Returns the dictionary_id of the dictionary holding code_lengths_data, which is the CRC32C of
+// its bytes, so that dictionaries with the same bit sequences have the same ID.
+uint32_t ComputeDictionaryId(const CodeLengthsFileRepr &code_lengths_data);
 
-// Creates and returns the contents of the compressed file that's based on tree_data and file_data.
+// Calculates a checksum of the given type (see Checksum) based on the contents of the given string.
+uint32_t ComputeChecksum(std::string_view data, const int checksum_type);
+// Returns the type of checksum that the blocks of a file with the given flags use.
+// Files without FLAG_CRC32C (including version 1 and 2 files) use CHECKSUM_SIMPLE.
+int BlockChecksumType(const uint32_t stream_flags);
+
+// Creates and returns the contents of the (version 1) compressed file
+// that's based on tree_data and file_data.
 std::string BuildFile(const TreeFileRepr &tree_data, CompressedFileRepr &file_data);
+// Creates and returns the contents of the (version 2) compressed file
+// that's based on code_lengths_data and file_data.
+std::string BuildFile(const CodeLengthsFileRepr &code_lengths_data, CompressedFileRepr &file_data);
+
+// Creates and returns the StreamHeader bytes that start a (version 3) compressed file.
+std::string BuildStreamHeader(const uint32_t block_size, const uint32_t flags);
+// Creates and returns the bytes of a BLOCK_HUFFMAN block that holds uncompressed_length bytes,
+// based on code_lengths_data and file_data, for a file with the given flags.
+std::string BuildBlock(const CodeLengthsFileRepr &code_lengths_data,
+    CompressedFileRepr &file_data, const uint32_t uncompressed_length,
+    const uint32_t stream_flags);
+// Same as above, but for files with FLAG_SYNC_POINTS: the block also holds sync_points_data.
+std::string BuildBlock(const CodeLengthsFileRepr &code_lengths_data,
+    CompressedFileRepr &file_data, const SyncPointsFileRepr &sync_points_data,
+    const uint32_t uncompressed_length, const uint32_t stream_flags);
+// Creates and returns the bytes of a BLOCK_DICTIONARY block that holds uncompressed_length bytes,
+// based on file_data (compressed with the bit sequences of the dictionary with the given ID),
+// for a file with the given flags.
+std::string BuildBlock(const uint32_t dictionary_id, CompressedFileRepr &file_data,
+    const uint32_t uncompressed_length, const uint32_t stream_flags);
+// Same as above, but for files with FLAG_SYNC_POINTS: the block also holds sync_points_data.
+std::string BuildBlock(const uint32_t dictionary_id, CompressedFileRepr &file_data,
+    const SyncPointsFileRepr &sync_points_data, const uint32_t uncompressed_length,
+    const uint32_t stream_flags);
+// Creates and returns the bytes of a BLOCK_REPEAT block that holds uncompressed_length bytes,
+// based on file_data (compressed with the bit sequences of the block before it), for a file with
+// the given flags.
+std::string BuildRepeatBlock(CompressedFileRepr &file_data, const uint32_t uncompressed_length,
+    const uint32_t stream_flags);
+// Same as above, but for files with FLAG_SYNC_POINTS: the block also holds sync_points_data.
+std::string BuildRepeatBlock(CompressedFileRepr &file_data,
+    const SyncPointsFileRepr &sync_points_data, const uint32_t uncompressed_length,
+    const uint32_t stream_flags);
+// Creates and returns the bytes of a BLOCK_CONTEXT block that holds uncompressed_length bytes,
+// based on context_map_data, tables_data (the CodeLengthsFileRepr of each of its tables) and
+// file_data, for a file with the given flags.
+std::string BuildContextBlock(const ContextMapFileRepr &context_map_data,
+    const std::vector<CodeLengthsFileRepr> &tables_data, CompressedFileRepr &file_data,
+    const uint32_t uncompressed_length, const uint32_t stream_flags);
+// Creates and returns the bytes of a BLOCK_STORED block that holds file_bytes as they are,
+// for a file with the given flags.
+std::string BuildStoredBlock(std::string_view file_bytes, const uint32_t stream_flags);
+// Creates and returns the bytes of a BLOCK_RUNS block that holds uncompressed_length bytes,
+// based on runs_data (see EncodeRuns), for a file with the given flags.
+std::string BuildRunsBlock(std::string_view runs_data, const uint32_t uncompressed_length,
+    const uint32_t stream_flags);
+// Creates and returns the bytes of the BLOCK_END block that ends a (version 3) compressed file
+// with the given flags.
+std::string BuildEndBlock(const uint32_t stream_flags);
+
+// Creates and returns the contents of the dictionary file that's based on code_lengths_data.
+std::string BuildDictionary(const CodeLengthsFileRepr &code_lengths_data);
 
 }  // namespace huffman
 
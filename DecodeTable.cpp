@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "DecodeTable.h"
+
+namespace huffman {
+
+uint16_t FlattenTree(const TreeNode &current_node, std::vector<DecodeNode> &nodes);
+
+void BuildDecodeTable(const TreeNode &current_node, const uint32_t code, const int depth,
+    DecodeEntry *table, std::vector<DecodeNode> &nodes, int &min_length);
+
+DecodeTable::DecodeTable(const TreeNode &root) {
+    if (root.IsLeaf()) {
+        single_leaf_ = true;
+        single_key_ = root.GetKey();
+        return;
+    }
+    BuildDecodeTable(root, 0, 0, table_, nodes_, min_length_);
+    FindMaxLength();
+}
+
+DecodeTable::DecodeTable(const CodeLengths &code_lengths) {
+    std::vector<unsigned char> order = CanonicalOrder(code_lengths);
+    if (order.size() == 1) {
+        single_leaf_ = true;
+        single_key_ = order.front();
+        // the char's bit sequence is one bit long; the table is only looked up by
+        // DecodeWithContexts, which doesn't check for single leaves
+        for (DecodeEntry &entry : table_) {
+            entry = { single_key_, 1 };
+        }
+        return;
+    }
+
+    std::array<uint64_t, NUM_CHARS> codes = CanonicalCodes(code_lengths);
+    std::vector<int> prefix_nodes(TABLE_SIZE, -1);
+    for (const unsigned char c : order) {
+        Insert(c, codes[c], code_lengths[c], prefix_nodes);
+    }
+    FindMaxLength();
+}
+
+void DecodeTable::FindMaxLength() {
+    if (!nodes_.empty()) {
+        max_length_ = TABLE_BITS + 1;
+        return;
+    }
+    for (const DecodeEntry &entry : table_) {
+        max_length_ = std::max<int>(max_length_, entry.length);
+    }
+}
+
+void DecodeTable::Insert(const unsigned char key, const uint64_t code, const int length,
+    std::vector<int> &prefix_nodes) {
+    min_length_ = std::min(min_length_, length);
+    if (length <= TABLE_BITS) {
+        FillEntries(table_, code, length, { key, static_cast<uint8_t>(length) });
+        return;
+    }
+
+    // bits past the first TABLE_BITS are decoded by walking a tree made of the longer sequences
+    // sharing the same first TABLE_BITS bits; a node is never a child of node 0, so 0 means unset
+    uint64_t prefix = code & (TABLE_SIZE - 1);
+    if (prefix_nodes[prefix] == -1) {
+        prefix_nodes[prefix] = nodes_.size();
+        nodes_.push_back({ { 0, 0 } });
+        table_[prefix] = { static_cast<uint16_t>(prefix_nodes[prefix]), 0 };
+    }
+    uint16_t node = prefix_nodes[prefix];
+    for (int i = TABLE_BITS; i < length - 1; i++) {
+        int bit = (code >> i) & 0x1;
+        if (nodes_[node].children[bit] == 0) {
+            nodes_[node].children[bit] = nodes_.size();
+            nodes_.push_back({ { 0, 0 } });
+        }
+        node = nodes_[node].children[bit];
+    }
+    nodes_[node].children[(code >> (length - 1)) & 0x1] = LEAF_FLAG | key;
+}
+
+void BuildDecodeTable(const TreeNode &current_node, const uint32_t code, const int depth,
+    DecodeEntry *table, std::vector<DecodeNode> &nodes, int &min_length) {
+    if (current_node.IsLeaf()) {
+        // every index whose lowest depth bits are this leaf's bit sequence decodes to this leaf
+        FillEntries(table, code, depth, { current_node.GetKey(), static_cast<uint8_t>(depth) });
+        min_length = std::min(min_length, depth);
+    } else if (depth == TABLE_BITS) {
+        table[code] = { FlattenTree(current_node, nodes), 0 };
+    } else {
+        BuildDecodeTable(*current_node.GetLeft(), code, depth + 1, table, nodes, min_length);
+        BuildDecodeTable(*current_node.GetRight(), code | (1 << depth), depth + 1, table, nodes,
+            min_length);
+    }
+}
+
+uint16_t FlattenTree(const TreeNode &current_node, std::vector<DecodeNode> &nodes) {
+    if (current_node.IsLeaf()) {
+        return LEAF_FLAG | current_node.GetKey();
+    }
+    uint16_t index = nodes.size();
+    nodes.emplace_back();
+    uint16_t left = FlattenTree(*current_node.GetLeft(), nodes);
+    uint16_t right = FlattenTree(*current_node.GetRight(), nodes);
+    nodes[index] = { { left, right } };
+    return index;
+}
+
+bool DecodeTable::Decode(BitReader &reader, uint64_t num_bits, std::string &output) const {
+    if (single_leaf_) {
+        output.append(num_bits, single_key_);
+        return true;
+    }
+    output.reserve(output.size() + num_bits / min_length_);
+
+    uint64_t num_bits_read = 0;
+    while (num_bits_read < num_bits) {
+        // after a refill, there are enough bits for SYMBOLS_PER_REFILL table lookups
+        reader.Refill();
+        for (int i = 0; i < SYMBOLS_PER_REFILL && num_bits_read < num_bits; i++) {
+            const DecodeEntry &entry = table_[reader.Peek(TABLE_BITS)];
+            if (entry.length != 0) {
+                reader.Consume(entry.length);
+                num_bits_read += entry.length;
+                output.push_back(entry.value);
+            } else {
+                reader.Consume(TABLE_BITS);
+                num_bits_read += TABLE_BITS;
+                output.push_back(DecodeSlow(reader, entry.value, num_bits_read));
+                break;
+            }
+        }
+    }
+
+    return num_bits_read == num_bits;
+}
+
+bool DecodeTable::Decode(BitReader &reader, uint64_t num_bits, char *output,
+    size_t num_chars) const {
+    return DecodeChars(reader, num_bits, output, num_chars) == num_bits;
+}
+
+bool DecodeTable::DecodePrefix(BitReader &reader, uint64_t num_bits, char *output,
+    size_t num_chars) const {
+    return DecodeChars(reader, num_bits, output, num_chars) <= num_bits;
+}
+
+uint64_t DecodeTable::DecodeChars(BitReader &reader, uint64_t num_bits, char *output,
+    size_t num_chars) const {
+    if (single_leaf_) {
+        std::fill(output, output + num_chars, single_key_);
+        return num_chars;
+    }
+    // a bit sequence of at most SHORT_TABLE_BITS bits fills every entry whose lowest bits are
+    // that sequence, so the table's first 1 << SHORT_TABLE_BITS entries are a table of their own
+    if (max_length_ <= SHORT_TABLE_BITS) {
+        return DecodeCharsKernel<SHORT_TABLE_BITS, false>(reader, num_bits, output, num_chars);
+    } else if (max_length_ <= TABLE_BITS) {
+        return DecodeCharsKernel<TABLE_BITS, false>(reader, num_bits, output, num_chars);
+    }
+    return DecodeCharsKernel<TABLE_BITS, true>(reader, num_bits, output, num_chars);
+}
+
+template <int PeekBits, bool HasLongCodes>
+uint64_t DecodeTable::DecodeCharsKernel(BitReader &reader, uint64_t num_bits, char *output,
+    size_t num_chars) const {
+    constexpr int chars_per_refill = CharsPerRefill(HasLongCodes ? TABLE_BITS + 1 : PeekBits);
+    uint64_t num_bits_read = 0;
+    size_t num_chars_read = 0;
+    while (num_chars_read < num_chars && num_bits_read <= num_bits) {
+        // after a refill, there are enough bits for chars_per_refill table lookups
+        reader.Refill();
+        if (!HasLongCodes && num_chars - num_chars_read >= chars_per_refill) {
+            for (int i = 0; i < chars_per_refill; i++) {
+                const DecodeEntry &entry = table_[reader.Peek(PeekBits)];
+                reader.Consume(entry.length);
+                num_bits_read += entry.length;
+                output[num_chars_read + i] = entry.value;
+            }
+            num_chars_read += chars_per_refill;
+            continue;
+        }
+        for (int i = 0; i < chars_per_refill && num_chars_read < num_chars; i++) {
+            const DecodeEntry &entry = table_[reader.Peek(PeekBits)];
+            if (!HasLongCodes || entry.length != 0) {
+                reader.Consume(entry.length);
+                num_bits_read += entry.length;
+                output[num_chars_read++] = entry.value;
+            } else {
+                reader.Consume(TABLE_BITS);
+                num_bits_read += TABLE_BITS;
+                output[num_chars_read++] = DecodeSlow(reader, entry.value, num_bits_read);
+                break;
+            }
+        }
+    }
+
+    // the loop only stops early once the bits run out, so then num_bits_read is over num_bits
+    return num_bits_read;
+}
+
+bool DecodeTable::DecodeInterleaved(const int num_streams, BitReader *readers,
+    const uint64_t *num_bits, char *const *outputs, const size_t *num_chars) const {
+    if (max_length_ <= SHORT_TABLE_BITS) {
+        return DecodeInterleavedKernel<SHORT_TABLE_BITS, false>(num_streams, readers, num_bits,
+            outputs, num_chars);
+    } else if (max_length_ <= TABLE_BITS) {
+        return DecodeInterleavedKernel<TABLE_BITS, false>(num_streams, readers, num_bits,
+            outputs, num_chars);
+    }
+    return DecodeInterleavedKernel<TABLE_BITS, true>(num_streams, readers, num_bits, outputs,
+        num_chars);
+}
+
+template <int PeekBits, bool HasLongCodes>
+bool DecodeTable::DecodeInterleavedKernel(const int num_streams, BitReader *readers,
+    const uint64_t *num_bits, char *const *outputs, const size_t *num_chars) const {
+    constexpr int chars_per_refill = CharsPerRefill(HasLongCodes ? TABLE_BITS + 1 : PeekBits);
+    size_t num_rounds = single_leaf_ ? 0 : *std::min_element(num_chars, num_chars + num_streams)
+        / chars_per_refill;
+    std::vector<uint64_t> num_bits_read(num_streams, 0);
+    for (size_t round = 0; round < num_rounds; round++) {
+        for (int s = 0; s < num_streams; s++) {
+            readers[s].Refill();
+        }
+        // each stream's next char only depends on that stream's bits,
+        // so the lookups of different streams don't wait on each other
+        const size_t first_char = round * chars_per_refill;
+        for (int i = 0; i < chars_per_refill; i++) {
+            for (int s = 0; s < num_streams; s++) {
+                const DecodeEntry &entry = table_[readers[s].Peek(PeekBits)];
+                if (!HasLongCodes || entry.length != 0) {
+                    readers[s].Consume(entry.length);
+                    num_bits_read[s] += entry.length;
+                    outputs[s][first_char + i] = entry.value;
+                } else {
+                    readers[s].Consume(TABLE_BITS);
+                    num_bits_read[s] += TABLE_BITS;
+                    outputs[s][first_char + i]
+                        = DecodeSlow(readers[s], entry.value, num_bits_read[s]);
+                    readers[s].Refill();
+                }
+            }
+        }
+    }
+
+    // the chars left over after the last full round are decoded one stream at a time
+    const size_t num_chars_decoded = num_rounds * chars_per_refill;
+    for (int s = 0; s < num_streams; s++) {
+        if (num_bits_read[s] > num_bits[s]
+            || !Decode(readers[s], num_bits[s] - num_bits_read[s], outputs[s] + num_chars_decoded,
+                num_chars[s] - num_chars_decoded)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DecodeTable::DecodeWithContexts(const DecodeTable *const *context_decode_tables,
+    BitReader &reader, uint64_t num_bits, char *output, size_t num_chars) {
+    return DecodeCharsWithContexts(context_decode_tables, reader, num_bits, output, num_chars)
+        == num_bits;
+}
+
+bool DecodeTable::DecodePrefixWithContexts(const DecodeTable *const *context_decode_tables,
+    BitReader &reader, uint64_t num_bits, char *output, size_t num_chars) {
+    return DecodeCharsWithContexts(context_decode_tables, reader, num_bits, output, num_chars)
+        <= num_bits;
+}
+
+uint64_t DecodeTable::DecodeCharsWithContexts(const DecodeTable *const *context_decode_tables,
+    BitReader &reader, uint64_t num_bits, char *output, size_t num_chars) {
+    int max_length = 1;
+    for (int context = 0; context < NUM_CHARS; context++) {
+        max_length = std::max(max_length, context_decode_tables[context]->max_length_);
+    }
+    if (max_length <= SHORT_TABLE_BITS) {
+        return DecodeCharsWithContextsKernel<SHORT_TABLE_BITS, false>(context_decode_tables,
+            reader, num_bits, output, num_chars);
+    } else if (max_length <= TABLE_BITS) {
+        return DecodeCharsWithContextsKernel<TABLE_BITS, false>(context_decode_tables, reader,
+            num_bits, output, num_chars);
+    }
+    return DecodeCharsWithContextsKernel<TABLE_BITS, true>(context_decode_tables, reader,
+        num_bits, output, num_chars);
+}
+
+template <int PeekBits, bool HasLongCodes>
+uint64_t DecodeTable::DecodeCharsWithContextsKernel(
+    const DecodeTable *const *context_decode_tables, BitReader &reader, uint64_t num_bits,
+    char *output, size_t num_chars) {
+    constexpr int chars_per_refill = CharsPerRefill(HasLongCodes ? TABLE_BITS + 1 : PeekBits);
+    uint64_t num_bits_read = 0;
+    size_t num_chars_read = 0;
+    unsigned char previous = 0;
+    while (num_chars_read < num_chars && num_bits_read <= num_bits) {
+        // after a refill, there are enough bits for chars_per_refill table lookups
+        reader.Refill();
+        for (int i = 0; i < chars_per_refill && num_chars_read < num_chars; i++) {
+            const DecodeTable &decode_table = *context_decode_tables[previous];
+            const DecodeEntry &entry = decode_table.table_[reader.Peek(PeekBits)];
+            if (!HasLongCodes || entry.length != 0) {
+                reader.Consume(entry.length);
+                num_bits_read += entry.length;
+                previous = entry.value;
+                output[num_chars_read++] = previous;
+            } else {
+                reader.Consume(TABLE_BITS);
+                num_bits_read += TABLE_BITS;
+                previous = decode_table.DecodeSlow(reader, entry.value, num_bits_read);
+                output[num_chars_read++] = previous;
+                break;
+            }
+        }
+    }
+
+    return num_bits_read;
+}
+
+unsigned char DecodeTable::DecodeSlow(BitReader &reader, uint16_t node,
+    uint64_t &num_bits_read) const {
+    while (!(node & LEAF_FLAG)) {
+        node = nodes_[node].children[reader.ReadBit()];
+        num_bits_read++;
+    }
+    return node & ~LEAF_FLAG;
+}
+
+}  // namespace huffman
@@ -0,0 +1,126 @@
+#ifndef _DECODETABLE_H_
+#define _DECODETABLE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "TreeNode.h"
+#include "Bits.h"
+#include "CanonicalCode.h"
+
+namespace huffman {
+
+#define TABLE_BITS 11
+#define TABLE_SIZE (1 << TABLE_BITS)
+#define SYMBOLS_PER_REFILL 4
+#define REFILL_BITS 56
+#define SHORT_TABLE_BITS 8
+#define LEAF_FLAG 0x8000
+
+// Returns how many chars a decoding kernel looks up after each refill of its BitReader, for bit
+// sequences of up to max_length bits (more than TABLE_BITS meaning some go past the table):
+// as many as are sure to fit in the REFILL_BITS bits of a refill.
+constexpr int CharsPerRefill(const int max_length) {
+    return max_length > TABLE_BITS ? SYMBOLS_PER_REFILL : REFILL_BITS / max_length;
+}
+
+// This struct represents one entry of a DecodeTable's lookup table.
+struct DecodeEntry {
+    uint16_t value;     // the decoded char, or (if length is 0) the node to continue walking from
+    uint8_t length;     // the number of bits the decoded char's bit sequence takes up
+};
+
+// This struct represents a node in the flattened tree used for bit sequences
+// longer than TABLE_BITS.
+struct DecodeNode {
+    uint16_t children[2];   // indices of the left/right nodes, or a char ORed with LEAF_FLAG
+};
+
+// Fills the entries of a TABLE_SIZE-entry table that the given bit sequence (first bit lowest)
+// of the given length (up to TABLE_BITS) is looked up at, which are those whose lowest length
+// bits are it, with entry. Can be evaluated at compile time, though every DecodeTable is built
+// at run time from the bit sequences of the block it decodes.
+constexpr void FillEntries(DecodeEntry *table, const uint64_t code, const int length,
+    const DecodeEntry entry) {
+    for (uint64_t i = code; i < TABLE_SIZE; i += uint64_t(1) << length) {
+        table[i] = entry;
+    }
+}
+
+// This class maps (compressed) bit sequences back to chars by looking up the next TABLE_BITS bits
+// of the compressed data at once, instead of walking a tree one bit at a time.
+class DecodeTable {
+ public:
+    // Creates a DecodeTable that decodes the bit sequences of the leaf nodes of the given tree.
+    explicit DecodeTable(const TreeNode &root);
+    // Creates a DecodeTable that decodes the canonical bit sequences of the given lengths.
+    // The lengths must describe a complete code (see CodeLengthsAreComplete).
+    explicit DecodeTable(const CodeLengths &code_lengths);
+
+    // Decodes num_bits bits from the given BitReader, appending the decoded chars to output.
+    // Returns false if the bits end partway through a bit sequence.
+    bool Decode(BitReader &reader, uint64_t num_bits, std::string &output) const;
+    // Decodes num_chars chars from the given BitReader into output, which must have room for them.
+    // Returns false unless the decoded chars' bit sequences take up exactly num_bits bits.
+    bool Decode(BitReader &reader, uint64_t num_bits, char *output, size_t num_chars) const;
+    // Same as above, but decodes only the first num_chars chars of num_bits bits, for reading part
+    // of a block. Returns false if those chars' bit sequences take up more than num_bits bits.
+    bool DecodePrefix(BitReader &reader, uint64_t num_bits, char *output, size_t num_chars) const;
+    // Same as above, but decodes num_streams independent streams side by side, a few chars from
+    // each at a time, so that the processor can work on the streams' lookups at once. Stream i
+    // decodes num_chars[i] chars from readers[i] into outputs[i], and must take up exactly
+    // num_bits[i] bits.
+    bool DecodeInterleaved(const int num_streams, BitReader *readers, const uint64_t *num_bits,
+        char *const *outputs, const size_t *num_chars) const;
+    // Same as the second Decode, but decodes each char with context_decode_tables[c], where c is
+    // the char before it (or 0, for the first char). The tables must be made from code lengths.
+    static bool DecodeWithContexts(const DecodeTable *const *context_decode_tables,
+        BitReader &reader, uint64_t num_bits, char *output, size_t num_chars);
+    // Same as above, but decodes only the first num_chars chars of num_bits bits
+    // (see DecodePrefix).
+    static bool DecodePrefixWithContexts(const DecodeTable *const *context_decode_tables,
+        BitReader &reader, uint64_t num_bits, char *output, size_t num_chars);
+
+ private:
+    // Decodes num_chars chars from the given BitReader into output, stopping early if their bit
+    // sequences take up more than num_bits bits. Returns the number of bits read, which is more
+    // than num_bits if the chars didn't fit in them. Picks the kernel below for max_length_.
+    uint64_t DecodeChars(BitReader &reader, uint64_t num_bits, char *output,
+        size_t num_chars) const;
+    // Same as above, but looks up PeekBits bits at a time, which must cover every bit sequence
+    // unless HasLongCodes. Without long codes, a refill's lookups never take the slow path,
+    // so they are unrolled into CharsPerRefill(PeekBits) lookups in a row.
+    template <int PeekBits, bool HasLongCodes>
+    uint64_t DecodeCharsKernel(BitReader &reader, uint64_t num_bits, char *output,
+        size_t num_chars) const;
+    // Same as DecodeInterleaved, but with the kernel above's PeekBits and HasLongCodes.
+    template <int PeekBits, bool HasLongCodes>
+    bool DecodeInterleavedKernel(const int num_streams, BitReader *readers,
+        const uint64_t *num_bits, char *const *outputs, const size_t *num_chars) const;
+    // Same as DecodeChars, but with the tables of DecodeWithContexts.
+    static uint64_t DecodeCharsWithContexts(const DecodeTable *const *context_decode_tables,
+        BitReader &reader, uint64_t num_bits, char *output, size_t num_chars);
+    template <int PeekBits, bool HasLongCodes>
+    static uint64_t DecodeCharsWithContextsKernel(
+        const DecodeTable *const *context_decode_tables, BitReader &reader, uint64_t num_bits,
+        char *output, size_t num_chars);
+    // Sets max_length_ from the filled-in table.
+    void FindMaxLength();
+    // Adds the given bit sequence (first bit lowest) of the given char to the table/tree.
+    void Insert(const unsigned char key, const uint64_t code, const int length,
+        std::vector<int> &prefix_nodes);
+    // Reads bits from the given BitReader starting at the given flattened tree node
+    // until a leaf is reached. Returns the leaf's char and adds the bits read to num_bits_read.
+    unsigned char DecodeSlow(BitReader &reader, uint16_t node, uint64_t &num_bits_read) const;
+
+    DecodeEntry table_[TABLE_SIZE] = { };
+    std::vector<DecodeNode> nodes_;
+    unsigned char single_key_;
+    bool single_leaf_ = false;
+    int min_length_ = TABLE_BITS;
+    int max_length_ = 1;        // the longest bit sequence, or TABLE_BITS + 1 if some are longer
+};
+
+}  // namespace huffman
+
+#endif  // _DECODETABLE_H_
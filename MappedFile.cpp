@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "MappedFile.h"
+
+namespace huffman {
+
+MappedFile::MappedFile(const int fd, char *data, const size_t num_bytes, const bool writable)
+    : fd_(fd), data_(data), num_bytes_(num_bytes), stream_(this) {
+    setg(data_, data_, data_ + num_bytes_);
+    if (writable) {
+        setp(data_, data_ + num_bytes_);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (fd_ == -1) {
+        return;
+    }
+    if (num_bytes_ != 0) {
+        munmap(data_, num_bytes_);
+    }
+    close(fd_);
+}
+
+std::unique_ptr<MappedFile> MappedFile::OpenForReading(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+
+    // an empty file can't be mapped, but has no bytes to read anyway
+    size_t num_bytes = file_stat.st_size;
+    if (num_bytes == 0) {
+        return std::unique_ptr<MappedFile>(new MappedFile(fd, nullptr, 0, false));
+    }
+
+    void *data = mmap(nullptr, num_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+    madvise(data, num_bytes, MADV_SEQUENTIAL);
+    return std::unique_ptr<MappedFile>(
+        new MappedFile(fd, static_cast<char *>(data), num_bytes, false));
+}
+
+std::unique_ptr<MappedFile> MappedFile::CreateForWriting(const std::string &filename,
+    const size_t num_bytes) {
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1 || !S_ISREG(file_stat.st_mode)
+        || ftruncate(fd, num_bytes) == -1) {
+        close(fd);
+        return nullptr;
+    }
+
+    if (num_bytes == 0) {
+        return std::unique_ptr<MappedFile>(new MappedFile(fd, nullptr, 0, true));
+    }
+
+    void *data = mmap(nullptr, num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+    madvise(data, num_bytes, MADV_SEQUENTIAL);
+    return std::unique_ptr<MappedFile>(
+        new MappedFile(fd, static_cast<char *>(data), num_bytes, true));
+}
+
+std::unique_ptr<MappedFile> MappedFile::ReadIntoBuffer(const std::string &filename,
+    std::string &buffer) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+
+    buffer.resize(file_stat.st_size);
+    size_t num_read = 0;
+    while (num_read < buffer.size()) {
+        ssize_t result = read(fd, &buffer[num_read], buffer.size() - num_read);
+        if (result <= 0) {
+            close(fd);
+            return nullptr;
+        }
+        num_read += result;
+    }
+    close(fd);
+    return std::unique_ptr<MappedFile>(new MappedFile(-1, &buffer[0], buffer.size(), false));
+}
+
+std::unique_ptr<MappedFile> MappedFile::ViewBuffer(std::string &buffer) {
+    return std::unique_ptr<MappedFile>(new MappedFile(-1, &buffer[0], buffer.size(), true));
+}
+
+void MappedFile::LoadPages(const size_t offset, const size_t num_bytes) const {
+    // the bytes of a buffer are already in memory
+    if (fd_ == -1 || offset >= num_bytes_) {
+        return;
+    }
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    const size_t end = std::min(offset + num_bytes, num_bytes_);
+    // reading one byte of each page faults the page in; the reads are volatile so that they
+    // aren't optimized away
+    const volatile char *data = data_;
+    for (size_t i = offset - offset % page_size; i < end; i += page_size) {
+        data[i];
+    }
+}
+
+void MappedFile::AdviseRandomAccess() const {
+    if (fd_ != -1 && num_bytes_ != 0) {
+        madvise(data_, num_bytes_, MADV_RANDOM);
+    }
+}
+
+}  // namespace huffman
@@ -0,0 +1,70 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+namespace huffman {
+
+// This class represents a file whose bytes are mapped into memory, so that they can be read or
+// written in place instead of being copied through a stream's buffers. The bytes can also be
+// read or written through a stream, for code that doesn't need them in place.
+class MappedFile : private std::streambuf {
+ public:
+    // Maps the file at filename for reading, hinting that it will be read from start to end.
+    // Returns nullptr if the file can't be mapped (e.g. it is a pipe or doesn't exist).
+    static std::unique_ptr<MappedFile> OpenForReading(const std::string &filename);
+    // Creates (or truncates) the file at filename to be num_bytes long and maps it for writing.
+    // Returns nullptr if the file can't be created or mapped.
+    static std::unique_ptr<MappedFile> CreateForWriting(const std::string &filename,
+        const size_t num_bytes);
+    // Reads the whole (regular) file at filename into buffer, reusing buffer's memory, and returns
+    // a MappedFile that views buffer as the file's mapped bytes. This is cheaper than mapping for
+    // small files. buffer must outlive the returned MappedFile. Returns nullptr if the file can't
+    // be read.
+    static std::unique_ptr<MappedFile> ReadIntoBuffer(const std::string &filename,
+        std::string &buffer);
+    // Returns a MappedFile that views buffer as the mapped bytes of a file, for reading and
+    // writing in place, so that code for mapped files can work on a buffer in memory. buffer must
+    // outlive the returned MappedFile, and not change size while it is viewed.
+    static std::unique_ptr<MappedFile> ViewBuffer(std::string &buffer);
+    // Unmaps and closes the file.
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Returns the start of the mapped bytes of the file.
+    char *GetData() { return data_; }
+    // Returns the number of mapped bytes, which is the size of the file.
+    size_t GetSize() const { return num_bytes_; }
+    // Returns the mapped bytes of the file.
+    std::string_view GetBytes() const { return std::string_view(data_, num_bytes_); }
+    // Brings the pages holding the num_bytes mapped bytes from offset into memory, waiting for
+    // them to be read from the disk if they aren't there yet, so that later reads of the bytes
+    // don't wait.
+    void LoadPages(const size_t offset, const size_t num_bytes) const;
+    // Hints that the mapped bytes will be read in no particular order, so that reading some bytes
+    // only reads their pages from the disk, instead of reading ahead from them.
+    void AdviseRandomAccess() const;
+
+    // Returns a stream that reads (or, if the file was mapped for writing, writes) the mapped bytes
+    // from the start of the file.
+    std::iostream &GetStream() { return stream_; }
+
+ private:
+    MappedFile(const int fd, char *data, const size_t num_bytes, const bool writable);
+
+    int fd_;                // the file's descriptor, or -1 if its bytes are in a buffer
+    char *data_;
+    size_t num_bytes_;
+    std::iostream stream_;
+};
+
+}  // namespace huffman
+
+#endif  // _MAPPEDFILE_H_
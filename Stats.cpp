@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <sys/resource.h>
+#include "Stats.h"
+
+namespace huffman {
+
+std::atomic<bool> phase_times_enabled(false);
+std::array<std::atomic<uint64_t>, NUM_PHASES> phase_wall_ns;
+std::array<std::atomic<uint64_t>, NUM_PHASES> phase_cpu_ns;
+
+// the innermost PhaseTimer running on each thread
+thread_local PhaseTimer *running_timer = nullptr;
+
+uint64_t WallNs();
+
+uint64_t ThreadCpuNs();
+
+uint64_t TimevalNs(const timeval &time);
+
+const char *PhaseName(const int phase) {
+    static const char *const names[NUM_PHASES] = {
+        "read", "histogram", "tree", "encode", "decode", "checksum", "write"
+    };
+    return names[phase];
+}
+
+void EnablePhaseTimes() {
+    phase_times_enabled = true;
+}
+
+PhaseTime GetPhaseTime(const int phase) {
+    return { phase_wall_ns[phase], phase_cpu_ns[phase] };
+}
+
+PhaseTimer::PhaseTimer(const int phase)
+    : phase_(phase), enabled_(phase_times_enabled), paused_(nullptr) {
+    if (!enabled_) {
+        return;
+    }
+    paused_ = running_timer;
+    if (paused_ != nullptr) {
+        paused_->Stop();
+    }
+    running_timer = this;
+    Start();
+}
+
+PhaseTimer::~PhaseTimer() {
+    if (!enabled_) {
+        return;
+    }
+    Stop();
+    running_timer = paused_;
+    if (paused_ != nullptr) {
+        paused_->Start();
+    }
+}
+
+void PhaseTimer::Start() {
+    wall_start_ns_ = WallNs();
+    cpu_start_ns_ = ThreadCpuNs();
+}
+
+void PhaseTimer::Stop() {
+    phase_wall_ns[phase_] += WallNs() - wall_start_ns_;
+    phase_cpu_ns[phase_] += ThreadCpuNs() - cpu_start_ns_;
+}
+
+void AddStreamStats(StreamStats &total, const StreamStats &stats) {
+    total.input_bytes += stats.input_bytes;
+    total.output_bytes += stats.output_bytes;
+    total.num_chars += stats.num_chars;
+    total.num_bits += stats.num_bits;
+    total.has_entropy = total.has_entropy || stats.has_entropy;
+    total.entropy_bits += stats.entropy_bits;
+    total.max_code_length = std::max(total.max_code_length, stats.max_code_length);
+}
+
+double EntropyBits(const ByteHistogram &byte_histogram) {
+    uint64_t num_chars = 0;
+    for (const uint64_t count : byte_histogram) {
+        num_chars += count;
+    }
+    double entropy_bits = 0;
+    for (const uint64_t count : byte_histogram) {
+        if (count != 0) {
+            entropy_bits -= count * std::log2(static_cast<double>(count) / num_chars);
+        }
+    }
+    return entropy_bits;
+}
+
+void WriteStatsJson(std::ostream &out, const std::string &mode, const bool succeeded,
+    const StreamStats &stats, const uint64_t wall_ns) {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    out << "{\"mode\":\"" << mode << "\",\"succeeded\":" << (succeeded ? "true" : "false")
+        << ",\"input_bytes\":" << stats.input_bytes << ",\"output_bytes\":" << stats.output_bytes
+        << ",\"num_chars\":" << stats.num_chars << ",\"num_bits\":" << stats.num_bits;
+
+    // bits per symbol are of the compressed content alone and of the whole compressed file,
+    // per uncompressed byte
+    uint64_t compressed_bytes = mode == "decompress" ? stats.input_bytes : stats.output_bytes;
+    out << ",\"bits_per_symbol\":";
+    if (stats.num_chars != 0) {
+        out << static_cast<double>(stats.num_bits) / stats.num_chars
+            << ",\"file_bits_per_symbol\":" << 8.0 * compressed_bytes / stats.num_chars;
+    } else {
+        out << "null,\"file_bits_per_symbol\":null";
+    }
+
+    out << ",\"entropy_bits_per_symbol\":";
+    if (stats.has_entropy && stats.num_chars != 0) {
+        out << stats.entropy_bits / stats.num_chars << ",\"entropy_bound_bytes\":"
+            << static_cast<uint64_t>(std::ceil(stats.entropy_bits / 8));
+    } else {
+        out << "null,\"entropy_bound_bytes\":null";
+    }
+
+    out << ",\"max_code_length\":";
+    if (stats.max_code_length != 0) {
+        out << stats.max_code_length;
+    } else {
+        out << "null";
+    }
+
+    out << ",\"wall_ns\":" << wall_ns << ",\"cpu_ns\":"
+        << TimevalNs(usage.ru_utime) + TimevalNs(usage.ru_stime)
+        << ",\"peak_rss_bytes\":" << static_cast<uint64_t>(usage.ru_maxrss) * 1024
+        << ",\"phases\":{";
+    for (int phase = 0; phase < NUM_PHASES; phase++) {
+        PhaseTime time = GetPhaseTime(phase);
+        out << (phase == 0 ? "" : ",") << "\"" << PhaseName(phase) << "\":{\"wall_ns\":"
+            << time.wall_ns << ",\"cpu_ns\":" << time.cpu_ns << "}";
+    }
+    out << "}}" << std::endl;
+}
+
+uint64_t WallNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t ThreadCpuNs() {
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+uint64_t TimevalNs(const timeval &time) {
+    return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_usec * 1000;
+}
+
+}  // namespace huffman
@@ -0,0 +1,86 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "UncompressedReader.h"
+
+namespace huffman {
+
+#define PHASE_READ 0        // reading the input (including parsing compressed blocks)
+#define PHASE_HISTOGRAM 1   // counting the bytes of uncompressed blocks
+#define PHASE_TREE 2        // choosing bit sequences, and building tables from them
+#define PHASE_ENCODE 3      // compressing bytes into bits
+#define PHASE_DECODE 4      // decompressing bits back into bytes
+#define PHASE_CHECKSUM 5    // computing or verifying block checksums
+#define PHASE_WRITE 6       // writing the output
+#define NUM_PHASES 7
+
+// The time spent in a phase, summed over all threads.
+struct PhaseTime {
+    uint64_t wall_ns;   // the time that passed while the phase was running
+    uint64_t cpu_ns;    // the CPU time that the threads running the phase used
+};
+
+// Returns the name of the given phase, as it is written in stats records.
+const char *PhaseName(const int phase);
+
+// Starts adding up the time spent in each phase. Until this is called, PhaseTimers do nothing,
+// so timing costs nothing unless it is asked for.
+void EnablePhaseTimes();
+// Returns the time spent in the given phase so far.
+PhaseTime GetPhaseTime(const int phase);
+
+// This class adds the time from its construction to its destruction to a phase, if phase times
+// are enabled. A PhaseTimer made while another one is running on the same thread pauses the
+// other until it is destroyed, so nested phases are not counted twice.
+class PhaseTimer {
+ public:
+    explicit PhaseTimer(const int phase);
+    ~PhaseTimer();
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+ private:
+    // Starts or stops counting this timer's time (adding it to the phase when stopping).
+    void Start();
+    void Stop();
+
+    int phase_;
+    bool enabled_;
+    PhaseTimer *paused_;        // the timer that this one paused, if any
+    uint64_t wall_start_ns_;
+    uint64_t cpu_start_ns_;
+};
+
+// This struct represents what a compression or decompression did, for its stats record.
+struct StreamStats {
+    uint64_t input_bytes = 0;
+    uint64_t output_bytes = 0;
+    uint64_t num_chars = 0;             // the number of uncompressed bytes
+    uint64_t num_bits = 0;              // the number of bits that the bytes compressed into,
+                                        // not counting headers and bit sequence lengths
+    bool has_entropy = false;
+    double entropy_bits = 0;            // the sum of EntropyBits of each block's histogram,
+                                        // if has_entropy
+    int max_code_length = 0;            // the longest bit sequence used (0 if not known)
+};
+
+// Adds the sizes, bits and entropy of stats to total, as if total's stream and stats's stream
+// were one stream.
+void AddStreamStats(StreamStats &total, const StreamStats &stats);
+
+// Returns the entropy of byte_histogram times its number of bytes: the fewest bits that any code
+// giving each byte one bit sequence could compress the bytes into.
+double EntropyBits(const ByteHistogram &byte_histogram);
+
+// Writes a stats record for a run of the given mode (e.g. "compress") to out, as one line of
+// JSON. The record holds stats, the time spent in each phase, the run's wall_ns, and the
+// process's CPU time and peak memory use so far.
+void WriteStatsJson(std::ostream &out, const std::string &mode, const bool succeeded,
+    const StreamStats &stats, const uint64_t wall_ns);
+
+}  // namespace huffman
+
+#endif  // _STATS_H_
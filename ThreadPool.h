@@ -0,0 +1,59 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace huffman {
+
+// This class represents a fixed number of threads that run submitted tasks in submission order
+// (though tasks can finish in any order).
+class ThreadPool {
+ public:
+    // Starts num_threads threads (or one per hardware thread, if num_threads is 0).
+    explicit ThreadPool(int num_threads);
+    // Waits for all submitted tasks to finish, then stops the threads.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Returns the number of threads running tasks.
+    int GetNumThreads() const { return workers_.size(); }
+
+    // Queues task to be run by one of the threads.
+    // Returns a future that holds task's result (or exception) once it has run.
+    template <class F>
+    std::future<std::invoke_result_t<F>> Submit(F task) {
+        auto packaged_task
+            = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::move(task));
+        std::future<std::invoke_result_t<F>> result = packaged_task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace([packaged_task]() { (*packaged_task)(); });
+        }
+        task_available_.notify_one();
+        return result;
+    }
+
+ private:
+    // Runs queued tasks until the pool is stopping and no tasks are left.
+    void RunTasks();
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable task_available_;
+    bool stopping_ = false;
+};
+
+}  // namespace huffman
+
+#endif  // _THREADPOOL_H_
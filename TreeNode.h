@@ -1,6 +1,7 @@
 #ifndef _TREENODE_H_
 #define _TREENODE_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -16,16 +17,17 @@ class TreeNode {
     // Constructs a non-leaf node whose left and right children are the given nodes.
     TreeNode(std::unique_ptr<TreeNode> left, std::unique_ptr<TreeNode> right) :
         weight_(left->GetWeight() + right->GetWeight()),
+        key_(0),
         left_(std::move(left)),
         right_(std::move(right)),
         is_leaf_(false) { }
 
     // Constructs a leaf node that has the given key and weight.
-    TreeNode(const unsigned char key, const int weight)
+    TreeNode(const unsigned char key, const uint64_t weight)
         : weight_(weight), key_(key), is_leaf_(true) { }
 
     // Returns this node's weight (for non-leaf nodes, this is the sum of the children's weights).
-    int GetWeight() const { return weight_; }
+    uint64_t GetWeight() const { return weight_; }
     // Gets the key of this node if it's a leaf node; throws invalid_argument otherwise.
     unsigned char GetKey() const;
     // Gets the left child node if this node is not a leaf node; throws invalid_argument otherwise.
@@ -36,7 +38,7 @@ class TreeNode {
     bool IsLeaf() const { return is_leaf_; }
 
  private:
-    int weight_;
+    uint64_t weight_;
     unsigned char key_;
     std::unique_ptr<TreeNode> left_;
     std::unique_ptr<TreeNode> right_;
@@ -5,8 +5,14 @@
 #include <sstream>
 #include <memory>
 #include <queue>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <cstring>
 #include "TreeNode.h"
 #include "UncompressedReader.h"
+#include "Stats.h"
 
 namespace huffman {
 
@@ -26,33 +32,90 @@ bool ReadFileContents(const std::string &file_name, std::string &file_bytes) {
         return false;
     }
 
-    std::stringstream file_bytes_builder;
-    unsigned char file_byte = byte_reader.get();
-    while (byte_reader.good()) {
-        file_bytes_builder << file_byte;
-        file_byte = byte_reader.get();
-    }
-    byte_reader.close();
+    // read the whole file with one call, instead of a byte at a time
+    byte_reader.seekg(0, std::ifstream::end);
+    file_bytes.resize(byte_reader.tellg());
+    byte_reader.seekg(0, std::ifstream::beg);
+    byte_reader.read(&file_bytes[0], file_bytes.size());
 
-    file_bytes = file_bytes_builder.str();
+    return static_cast<bool>(byte_reader);
+}
 
-    return true;
+bool ReadFileBlock(std::istream &input, const size_t block_size, std::string &block_bytes) {
+    block_bytes.resize(block_size);
+    input.read(&block_bytes[0], block_size);
+    block_bytes.resize(input.gcount());
+    return !block_bytes.empty();
 }
 
-std::unordered_map<unsigned char, int> GetByteFrequencies(const std::string &content) {
-    std::unordered_map<unsigned char, int> byte_to_frequency;
-    for (const unsigned char c : content) {
-        byte_to_frequency[c] += 1;
+ByteHistogram GetByteHistogram(std::string_view content) {
+    PhaseTimer timer(PHASE_HISTOGRAM);
+    // consecutive bytes are counted in different sub-histograms, so that a run of the same byte
+    // doesn't make each count wait for the count before it to be stored
+    ByteHistogram sub_histograms[NUM_SUB_HISTOGRAMS] = { };
+    const unsigned char *next = reinterpret_cast<const unsigned char *>(content.data());
+    const unsigned char *end = next + content.size();
+    for (; end - next >= 8; next += 8) {
+        uint64_t word;
+        memcpy(&word, next, sizeof(word));
+        for (int i = 0; i < 8; i++) {
+            sub_histograms[i % NUM_SUB_HISTOGRAMS][(word >> (8 * i)) & 0xff]++;
+        }
+    }
+    for (; next != end; next++) {
+        sub_histograms[0][*next]++;
+    }
+
+    ByteHistogram byte_histogram = sub_histograms[0];
+    for (int i = 1; i < NUM_SUB_HISTOGRAMS; i++) {
+        for (int c = 0; c < NUM_CHARS; c++) {
+            byte_histogram[c] += sub_histograms[i][c];
+        }
+    }
+    return byte_histogram;
+}
+
+ByteHistogram GetByteHistogram(std::string_view content, int num_threads) {
+    if (num_threads <= 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t num_parts = std::min<size_t>(num_threads,
+        std::max<size_t>(1, content.size() / MIN_BYTES_PER_HISTOGRAM_THREAD));
+    if (num_parts == 1) {
+        return GetByteHistogram(content);
+    }
+
+    // this thread counts the first part while the other threads count the rest
+    size_t part_size = content.size() / num_parts;
+    std::vector<ByteHistogram> part_histograms(num_parts);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_parts; i++) {
+        std::string_view part = content.substr(i * part_size,
+            i + 1 == num_parts ? std::string_view::npos : part_size);
+        threads.emplace_back([part, &part_histogram = part_histograms[i]]() {
+            part_histogram = GetByteHistogram(part);
+        });
     }
+    part_histograms[0] = GetByteHistogram(content.substr(0, part_size));
 
-    return byte_to_frequency;
+    ByteHistogram byte_histogram = part_histograms[0];
+    for (size_t i = 1; i < num_parts; i++) {
+        threads[i - 1].join();
+        for (int c = 0; c < NUM_CHARS; c++) {
+            byte_histogram[c] += part_histograms[i][c];
+        }
+    }
+    return byte_histogram;
 }
 
-NodePtr CreateTree(const std::unordered_map<unsigned char, int>& byte_to_frequency) {
+NodePtr CreateTree(const ByteHistogram &byte_histogram) {
     std::priority_queue<
         NodePtr, std::vector<NodePtr>, UniquePtrReverseComparer<huffman::TreeNode>> sorter;
-    for (const auto &kv : byte_to_frequency) {
-        sorter.emplace(std::make_unique<huffman::TreeNode>(huffman::TreeNode(kv.first, kv.second)));
+    for (int c = 0; c < NUM_CHARS; c++) {
+        if (byte_histogram[c] != 0) {
+            sorter.emplace(std::make_unique<huffman::TreeNode>(
+                huffman::TreeNode(c, byte_histogram[c])));
+        }
     }
 
     while (sorter.size() != 1) {
@@ -73,4 +136,157 @@ NodePtr CreateTree(const std::unordered_map<unsigned char, int>& byte_to_frequen
     return root;
 }
 
+CodeLengths HuffmanCodeLengths(const ByteHistogram &byte_histogram) {
+    // the used bytes, sorted by count
+    std::array<std::pair<uint64_t, unsigned char>, NUM_CHARS> leaves;
+    int n = 0;
+    for (int c = 0; c < NUM_CHARS; c++) {
+        if (byte_histogram[c] != 0) {
+            leaves[n++] = { byte_histogram[c], c };
+        }
+    }
+    std::sort(leaves.begin(), leaves.begin() + n);
+
+    CodeLengths code_lengths = { };
+    if (n == 1) {
+        code_lengths[leaves[0].second] = 1;
+    }
+    if (n <= 1) {
+        return code_lengths;
+    }
+
+    // Moffat and Katajainen's in-place algorithm, where a single array holds the counts, then the
+    // internal nodes' parents, then the internal nodes' depths, and finally the leaves' depths.
+    std::array<uint64_t, NUM_CHARS> a;
+    for (int i = 0; i < n; i++) {
+        a[i] = leaves[i].first;
+    }
+
+    // left to right: a[next] becomes the weight of the next internal node, made from the two
+    // lightest of the remaining leaves (from leaf) and unpaired internal nodes (from root);
+    // a paired internal node's entry becomes the index of its parent
+    a[0] += a[1];
+    int root = 0;
+    int leaf = 2;
+    for (int next = 1; next < n - 1; next++) {
+        if (leaf >= n || a[root] < a[leaf]) {
+            a[next] = a[root];
+            a[root++] = next;
+        } else {
+            a[next] = a[leaf++];
+        }
+        if (leaf >= n || (root < next && a[root] < a[leaf])) {
+            a[next] += a[root];
+            a[root++] = next;
+        } else {
+            a[next] += a[leaf++];
+        }
+    }
+
+    // right to left: each internal node is one deeper than its parent, the last one being the root
+    a[n - 2] = 0;
+    for (int next = n - 3; next >= 0; next--) {
+        a[next] = a[a[next]] + 1;
+    }
+
+    // right to left: the nodes at each depth that aren't internal nodes are leaves, and the
+    // lightest leaves are the deepest
+    int available = 1;
+    int used = 0;
+    uint64_t depth = 0;
+    root = n - 2;
+    int next = n - 1;
+    while (available > 0) {
+        while (root >= 0 && a[root] == depth) {
+            used++;
+            root--;
+        }
+        while (available > used) {
+            a[next--] = depth;
+            available--;
+        }
+        available = 2 * used;
+        depth++;
+        used = 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        code_lengths[leaves[i].second] = a[i];
+    }
+    return code_lengths;
+}
+
+CodeLengths LimitCodeLengths(const CodeLengths &code_lengths,
+    const ByteHistogram &byte_histogram, const int max_length) {
+    if (*std::max_element(code_lengths.begin(), code_lengths.end()) <= max_length) {
+        return code_lengths;
+    }
+
+    std::vector<std::pair<uint64_t, unsigned char>> leaves;
+    for (int c = 0; c < NUM_CHARS; c++) {
+        if (byte_histogram[c] != 0) {
+            leaves.emplace_back(byte_histogram[c], c);
+        }
+    }
+    std::sort(leaves.begin(), leaves.end());
+    if (max_length < 1
+        || (max_length < MIN_MAX_CODE_LENGTH && leaves.size() > (size_t(1) << max_length))) {
+        throw std::invalid_argument("max_length cannot fit a bit sequence for every char");
+    }
+
+    // Each level's list is the leaves merged (by weight) with packages made of adjacent pairs of
+    // the level below it; the deepest level only has leaves. Only whether each item is a leaf
+    // needs to be remembered, since the leaves always appear in increasing order.
+    std::vector<std::vector<bool>> level_is_leaf(max_length);
+    std::vector<uint64_t> below_weights;
+    for (const auto &leaf : leaves) {
+        below_weights.push_back(leaf.first);
+    }
+    level_is_leaf[max_length - 1] = std::vector<bool>(leaves.size(), true);
+
+    for (int level = max_length - 2; level >= 0; level--) {
+        std::vector<uint64_t> weights;
+        size_t leaf_index = 0;
+        size_t package_index = 0;
+        size_t num_packages = below_weights.size() / 2;
+        while (leaf_index < leaves.size() || package_index < num_packages) {
+            uint64_t package_weight = package_index < num_packages
+                ? below_weights[2 * package_index] + below_weights[2 * package_index + 1] : 0;
+            bool take_leaf = package_index == num_packages
+                || (leaf_index < leaves.size() && leaves[leaf_index].first <= package_weight);
+            if (take_leaf) {
+                weights.push_back(leaves[leaf_index++].first);
+            } else {
+                weights.push_back(package_weight);
+                package_index++;
+            }
+            level_is_leaf[level].push_back(take_leaf);
+        }
+        below_weights = std::move(weights);
+    }
+
+    // the first 2n - 2 items of the top level are chosen; a chosen package chooses the two items
+    // it was made from in the level below, and each time a leaf is chosen its length grows by 1
+    CodeLengths limited_lengths = { };
+    size_t num_chosen = 2 * leaves.size() - 2;
+    for (int level = 0; level < max_length; level++) {
+        size_t num_leaves_chosen = std::count(level_is_leaf[level].begin(),
+            level_is_leaf[level].begin() + num_chosen, true);
+        for (size_t i = 0; i < num_leaves_chosen; i++) {
+            limited_lengths[leaves[i].second]++;
+        }
+        num_chosen = 2 * (num_chosen - num_leaves_chosen);
+    }
+
+    return limited_lengths;
+}
+
+uint64_t CompressedNumBits(const CodeLengths &code_lengths, const ByteHistogram &byte_histogram) {
+    uint64_t num_bits = 0;
+    for (int c = 0; c < NUM_CHARS; c++) {
+        num_bits += byte_histogram[c] * code_lengths[c];
+    }
+    return num_bits;
+}
+
 }  // namespace huffman
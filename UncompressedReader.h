@@ -1,25 +1,63 @@
 #ifndef _UNCOMPRESSEDREADER_H_
 #define _UNCOMPRESSEDREADER_H_
 
+#include <array>
+#include <cstdint>
+#include <istream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <memory>
 #include "TreeNode.h"
+#include "CanonicalCode.h"
 
 namespace huffman {
 
+#define DEFAULT_MAX_CODE_LENGTH 15
+#define MIN_MAX_CODE_LENGTH 8   // the shortest limit that still leaves room for all NUM_CHARS chars
+
+#define NUM_SUB_HISTOGRAMS 4
+#define MIN_BYTES_PER_HISTOGRAM_THREAD (1 << 20)
+
 // Reads the file at file_name and writes its contents to file_bytes.
 // Returns whether the file read was successful.
 bool ReadFileContents(const std::string &file_name, std::string &file_bytes);
 
-// Creates a mapping of each different byte in the given string to its number of occurrences.
-std::unordered_map<unsigned char, int> GetByteFrequencies(const std::string &content);
+// Reads the next (up to) block_size bytes from input and writes them to block_bytes.
+// Returns whether any bytes were read.
+bool ReadFileBlock(std::istream &input, const size_t block_size, std::string &block_bytes);
+
+// The number of occurrences of each byte, indexed by the byte.
+typedef std::array<uint64_t, NUM_CHARS> ByteHistogram;
+
+// Counts the occurrences of each byte in content.
+ByteHistogram GetByteHistogram(std::string_view content);
+// Same as above, but splits content between num_threads threads (or one per hardware thread,
+// if num_threads is 0) and adds up their counts. Parts smaller than
+// MIN_BYTES_PER_HISTOGRAM_THREAD aren't split off, so small contents are counted on this thread.
+ByteHistogram GetByteHistogram(std::string_view content, int num_threads);
+
+// Creates a binary tree whose leaf nodes' keys are the bytes that occur in byte_histogram,
+// weighted by their counts. Bytes with lower counts are placed into leaf nodes that are deeper
+// within the tree. Returns the root node of this tree.
+std::unique_ptr<TreeNode> CreateTree(const ByteHistogram &byte_histogram);
+
+// Returns the lengths of the bit sequences that a Huffman tree (see CreateTree) would give the
+// bytes that occur in byte_histogram, without creating the tree or allocating any memory.
+// A single byte gets a length of 1. Ties between equal counts may be broken differently than
+// CreateTree does, but the lengths give the same number of compressed bits.
+CodeLengths HuffmanCodeLengths(const ByteHistogram &byte_histogram);
+
+// Returns code_lengths if none of its lengths exceed max_length. Otherwise, creates the lengths
+// (none exceeding max_length) that give the fewest compressed bits for byte_histogram,
+// using the package-merge algorithm. Throws invalid_argument if max_length is too short to give
+// every char of byte_histogram its own bit sequence.
+CodeLengths LimitCodeLengths(const CodeLengths &code_lengths,
+    const ByteHistogram &byte_histogram, const int max_length);
 
-// Creates a binary tree where leaf nodes' keys and weights are byte_to_frequency's keys and values.
-// Chars with lower values are placed into leaf nodes that are deeper within the tree.
-// Returns the root node of this tree.
-std::unique_ptr<TreeNode> CreateTree(
-    const std::unordered_map<unsigned char, int> &byte_to_frequency);
+// Returns the number of bits that the compressed data takes up
+// when the chars of byte_histogram get bit sequences of the given lengths.
+uint64_t CompressedNumBits(const CodeLengths &code_lengths, const ByteHistogram &byte_histogram);
 
 }  // namespace huffman
 
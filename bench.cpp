@@ -0,0 +1,369 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <functional>
+#include "TreeNode.h"
+#include "CanonicalCode.h"
+#include "UncompressedReader.h"
+#include "CompressedWriter.h"
+#include "CompressedReader.h"
+
+#define DEFAULT_REPETITIONS 5
+#define DEFAULT_WARMUP_RUNS 1
+#define DEFAULT_SYNTHETIC_SIZE (64 << 20)
+#define DEFAULT_TEXT_SIZE (1 << 30)
+
+#define BENCH_SEED 20240601     // so that every run benchmarks the same synthetic inputs
+#define TEXT_VOCABULARY_SIZE 4096
+#define TEXT_WORDS_PER_LINE 12
+
+// This struct represents the options passed to huffman_bench on the command line.
+struct BenchArguments {
+    int repetitions = DEFAULT_REPETITIONS;
+    int warmup_runs = DEFAULT_WARMUP_RUNS;
+    size_t synthetic_size = DEFAULT_SYNTHETIC_SIZE;
+    size_t text_size = DEFAULT_TEXT_SIZE;
+    bool synthetic = true;
+    std::vector<std::string> input_filenames;
+};
+
+// This struct represents the timings of one stage on one input, over all repetitions.
+struct StageTimings {
+    std::string input_name;
+    std::string stage;
+    uint64_t num_bytes;         // the uncompressed size of the input, which throughputs are of
+    std::vector<uint64_t> ns;   // the time each repetition took
+};
+
+void parse_args(int argc, char **argv, BenchArguments &args);
+void usage();
+
+std::string generate_uniform(const size_t size, std::mt19937_64 &rng);
+std::string generate_zipf(const size_t size, std::mt19937_64 &rng);
+std::string generate_single_symbol(const size_t size);
+std::string generate_text(const size_t size, std::mt19937_64 &rng);
+bool write_synthetic_input(const std::string &filename, const std::string &bytes);
+
+bool bench_file(const std::string &input_name, const std::string &filename,
+    const BenchArguments &args);
+void time_stage(const std::string &input_name, const std::string &stage, const uint64_t num_bytes,
+    const BenchArguments &args, const std::function<uint64_t()> &run_stage);
+void print_timings_header(std::ostream &out);
+void print_timings(std::ostream &out, StageTimings &timings);
+
+// the results of every timed run are added to this, so that no run can be optimized away
+volatile uint64_t result_sink = 0;
+
+int main(int argc, char **argv) {
+    std::ios::sync_with_stdio(false);
+
+    BenchArguments args;
+    parse_args(argc, argv, args);
+
+    print_timings_header(std::cout);
+    bool all_ok = true;
+    for (const std::string &filename : args.input_filenames) {
+        all_ok &= bench_file(filename, filename, args);
+    }
+
+    if (args.synthetic) {
+        // each synthetic input is written to a file first, so that ReadFileContents is timed
+        // for it as well, and removed once it has been benchmarked
+        std::mt19937_64 rng(BENCH_SEED);
+        std::vector<std::pair<std::string, std::function<std::string()>>> generators = {
+            { "synthetic:uniform", [&]() { return generate_uniform(args.synthetic_size, rng); } },
+            { "synthetic:zipf", [&]() { return generate_zipf(args.synthetic_size, rng); } },
+            { "synthetic:single", [&]() { return generate_single_symbol(args.synthetic_size); } },
+            { "synthetic:text", [&]() { return generate_text(args.text_size, rng); } },
+        };
+        for (const auto &[input_name, generate] : generators) {
+            std::string filename = (std::filesystem::temp_directory_path()
+                / ("huffman_bench_" + input_name.substr(input_name.find(':') + 1))).string();
+            std::cerr << "Generating " << input_name << "..." << std::endl;
+            if (!write_synthetic_input(filename, generate())) {
+                all_ok = false;
+                continue;
+            }
+            all_ok &= bench_file(input_name, filename, args);
+            std::remove(filename.c_str());
+        }
+    }
+    return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void parse_args(int argc, char **argv, BenchArguments &args) {
+    int input_index = 1;
+    for (; input_index < argc && argv[input_index][0] == '-'; input_index++) {
+        std::string option_str(argv[input_index]);
+        if (!option_str.compare("-n") && input_index + 1 < argc) {
+            args.repetitions = atoi(argv[++input_index]);
+            if (args.repetitions < 1) {
+                usage();
+            }
+        } else if (!option_str.compare("-w") && input_index + 1 < argc) {
+            args.warmup_runs = atoi(argv[++input_index]);
+            if (args.warmup_runs < 0) {
+                usage();
+            }
+        } else if (!option_str.compare("--synthetic-size") && input_index + 1 < argc) {
+            args.synthetic_size = strtoull(argv[++input_index], nullptr, 10);
+            if (args.synthetic_size == 0) {
+                usage();
+            }
+        } else if (!option_str.compare("--text-size") && input_index + 1 < argc) {
+            args.text_size = strtoull(argv[++input_index], nullptr, 10);
+            if (args.text_size == 0) {
+                usage();
+            }
+        } else if (!option_str.compare("--no-synthetic")) {
+            args.synthetic = false;
+        } else {
+            usage();
+        }
+    }
+
+    for (; input_index < argc; input_index++) {
+        args.input_filenames.emplace_back(argv[input_index]);
+    }
+    if (args.input_filenames.empty() && !args.synthetic) {
+        usage();
+    }
+}
+
+void usage() {
+    std::cerr << "USAGE: huffman_bench [-n <reps>] [-w <runs>] [--synthetic-size <bytes>] "
+        "[--text-size <bytes>] [--no-synthetic] [file ...]" << std::endl;
+    std::cerr << "    times each stage of (de)compressing each file, then each synthetic input,"
+        << std::endl;
+    std::cerr << "    and prints one CSV line per stage and input to stdout" << std::endl;
+    std::cerr << "    -n <reps> : time each stage reps times (default " << DEFAULT_REPETITIONS
+        << ")" << std::endl;
+    std::cerr << "    -w <runs> : run each stage runs times before timing it (default "
+        << DEFAULT_WARMUP_RUNS << ")" << std::endl;
+    std::cerr << "    --synthetic-size <bytes> : size of the uniform, zipf and single-symbol inputs"
+        << " (default " << DEFAULT_SYNTHETIC_SIZE << ")" << std::endl;
+    std::cerr << "    --text-size <bytes> : size of the text input (default " << DEFAULT_TEXT_SIZE
+        << ")" << std::endl;
+    std::cerr << "    --no-synthetic : only benchmark the given files" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+std::string generate_uniform(const size_t size, std::mt19937_64 &rng) {
+    std::string bytes(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = static_cast<char>(rng());
+    }
+    return bytes;
+}
+
+std::string generate_zipf(const size_t size, std::mt19937_64 &rng) {
+    // byte c occurs with probability proportional to 1 / (c + 1)
+    std::vector<double> weights(NUM_CHARS);
+    for (int c = 0; c < NUM_CHARS; c++) {
+        weights[c] = 1.0 / (c + 1);
+    }
+    std::discrete_distribution<int> distribution(weights.begin(), weights.end());
+    std::string bytes(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = static_cast<char>(distribution(rng));
+    }
+    return bytes;
+}
+
+std::string generate_single_symbol(const size_t size) {
+    return std::string(size, 'a');
+}
+
+std::string generate_text(const size_t size, std::mt19937_64 &rng) {
+    // lowercase words of 1 to 10 letters, drawn with Zipf frequencies, in lines of
+    // TEXT_WORDS_PER_LINE words that each start with a capital letter and end with a period
+    std::uniform_int_distribution<int> letter_distribution('a', 'z');
+    std::uniform_int_distribution<int> length_distribution(1, 10);
+    std::vector<std::string> vocabulary(TEXT_VOCABULARY_SIZE);
+    std::vector<double> weights(TEXT_VOCABULARY_SIZE);
+    for (int i = 0; i < TEXT_VOCABULARY_SIZE; i++) {
+        int length = length_distribution(rng);
+        for (int j = 0; j < length; j++) {
+            vocabulary[i] += static_cast<char>(letter_distribution(rng));
+        }
+        weights[i] = 1.0 / (i + 1);
+    }
+    std::discrete_distribution<int> word_distribution(weights.begin(), weights.end());
+
+    std::string bytes;
+    bytes.reserve(size + 16);
+    for (uint64_t word_count = 0; bytes.size() < size; word_count++) {
+        const std::string &word = vocabulary[word_distribution(rng)];
+        size_t word_start = bytes.size();
+        bytes += word;
+        if (word_count % TEXT_WORDS_PER_LINE == 0) {
+            bytes[word_start] = static_cast<char>(bytes[word_start] - 'a' + 'A');
+        }
+        bytes += word_count % TEXT_WORDS_PER_LINE == TEXT_WORDS_PER_LINE - 1 ? ".\n" : " ";
+    }
+    bytes.resize(size);
+    return bytes;
+}
+
+bool write_synthetic_input(const std::string &filename, const std::string &bytes) {
+    std::ofstream output(filename, std::ios::binary);
+    output.write(bytes.data(), bytes.size());
+    if (!output) {
+        std::cerr << "Could not write the synthetic input file " << filename << "!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool bench_file(const std::string &input_name, const std::string &filename,
+    const BenchArguments &args) {
+    std::string file_bytes;
+    if (!huffman::ReadFileContents(filename, file_bytes)) {
+        std::cerr << "Could not read " << filename << "!" << std::endl;
+        return false;
+    }
+    if (file_bytes.empty()) {
+        std::cerr << "Skipping " << input_name << ", which is empty" << std::endl;
+        return true;
+    }
+    std::cerr << "Benchmarking " << input_name << " (" << file_bytes.size() << " bytes)..."
+        << std::endl;
+    const uint64_t num_bytes = file_bytes.size();
+
+    // each stage is timed on the output of the stage before it; the outputs of the last run
+    // are kept for the next stage
+    time_stage(input_name, "ReadFileContents", num_bytes, args, [&]() {
+        huffman::ReadFileContents(filename, file_bytes);
+        return file_bytes.size();
+    });
+
+    huffman::ByteHistogram byte_histogram;
+    time_stage(input_name, "GetByteHistogram", num_bytes, args, [&]() {
+        byte_histogram = huffman::GetByteHistogram(file_bytes);
+        return byte_histogram[0];
+    });
+
+    std::unique_ptr<huffman::TreeNode> root;
+    time_stage(input_name, "CreateTree", num_bytes, args, [&]() {
+        root = huffman::CreateTree(byte_histogram);
+        return root->GetWeight();
+    });
+
+    time_stage(input_name, "TreeCharToBits", num_bytes, args, [&]() {
+        return huffman::TreeCharToBits(*root).size();
+    });
+
+    // the bit sequences that the compressor would give a block with this histogram
+    huffman::CodeLengths code_lengths;
+    time_stage(input_name, "HuffmanCodeLengths", num_bytes, args, [&]() {
+        code_lengths = huffman::LimitCodeLengths(huffman::HuffmanCodeLengths(byte_histogram),
+            byte_histogram, DEFAULT_MAX_CODE_LENGTH);
+        return code_lengths[0];
+    });
+    huffman::EncodeTable encode_table = huffman::CanonicalEncodeTable(code_lengths);
+
+    huffman::CompressedFileRepr file_data;
+    time_stage(input_name, "CompressFileBytes", num_bytes, args, [&]() {
+        file_data = huffman::CompressFileBytes(encode_table, file_bytes);
+        return file_data.num_bits;
+    });
+
+    time_stage(input_name, "ComputeChecksum:crc32c", num_bytes, args, [&]() {
+        return huffman::ComputeChecksum(file_data.compressed_bits, CHECKSUM_CRC32C);
+    });
+    time_stage(input_name, "ComputeChecksum:simple", num_bytes, args, [&]() {
+        return huffman::ComputeChecksum(file_data.compressed_bits, CHECKSUM_SIMPLE);
+    });
+
+    std::string compressed_file = huffman::BuildFile(
+        huffman::CodeLengthsToFileRepr(code_lengths), file_data);
+    huffman::CodeLengthsFileRepr partitioned_code_lengths;
+    huffman::CompressedFileRepr partitioned_file_data;
+    time_stage(input_name, "PartitionFileContents", num_bytes, args, [&]() {
+        return huffman::PartitionFileContents(compressed_file, partitioned_code_lengths,
+            partitioned_file_data) ? partitioned_file_data.num_bits : 0;
+    });
+
+    huffman::TreeFileRepr tree_data = huffman::TreeToFileRepr(*root);
+    time_stage(input_name, "TreeReprToTree", num_bytes, args, [&]() {
+        return huffman::TreeReprToTree(tree_data)->IsLeaf();
+    });
+
+    std::string decompressed_bytes;
+    time_stage(input_name, "DecompressFile", num_bytes, args, [&]() {
+        decompressed_bytes = huffman::DecompressFile(code_lengths, partitioned_file_data);
+        return decompressed_bytes.size();
+    });
+    if (decompressed_bytes != file_bytes) {
+        std::cerr << "Decompressing " << input_name << " did not give back its bytes!"
+            << std::endl;
+        return false;
+    }
+
+    // the same bit sequences in a (version 3) file of blocks, decompressed into a buffer that is
+    // sized once
+    std::string stream_file = huffman::BuildStreamHeader(DEFAULT_BLOCK_SIZE, FLAG_CRC32C);
+    for (size_t first_char = 0; first_char < file_bytes.size(); first_char += DEFAULT_BLOCK_SIZE) {
+        std::string_view block_bytes
+            = std::string_view(file_bytes).substr(first_char, DEFAULT_BLOCK_SIZE);
+        huffman::CompressedFileRepr block_data = huffman::CompressFileBytes(encode_table,
+            block_bytes);
+        stream_file += first_char == 0
+            ? huffman::BuildBlock(huffman::CodeLengthsToFileRepr(code_lengths), block_data,
+                block_bytes.size(), FLAG_CRC32C)
+            : huffman::BuildRepeatBlock(block_data, block_bytes.size(), FLAG_CRC32C);
+    }
+    stream_file += huffman::BuildEndBlock(FLAG_CRC32C);
+    std::string stream_decompressed_bytes(file_bytes.size(), '\0');
+    time_stage(input_name, "DecompressFile:blocks", num_bytes, args, [&]() {
+        return huffman::DecompressFile(stream_file, 0, nullptr, &stream_decompressed_bytes[0],
+            stream_decompressed_bytes.size());
+    });
+    if (stream_decompressed_bytes != file_bytes) {
+        std::cerr << "Decompressing the blocks of " << input_name
+            << " did not give back its bytes!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void time_stage(const std::string &input_name, const std::string &stage, const uint64_t num_bytes,
+    const BenchArguments &args, const std::function<uint64_t()> &run_stage) {
+    for (int i = 0; i < args.warmup_runs; i++) {
+        result_sink = result_sink + run_stage();
+    }
+
+    StageTimings timings = { input_name, stage, num_bytes, { } };
+    for (int i = 0; i < args.repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        result_sink = result_sink + run_stage();
+        auto end = std::chrono::steady_clock::now();
+        timings.ns.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+    print_timings(std::cout, timings);
+}
+
+void print_timings_header(std::ostream &out) {
+    out << "input,stage,bytes,repetitions,min_ns,median_ns,max_ns,ns_per_byte,mb_per_s"
+        << std::endl;
+}
+
+void print_timings(std::ostream &out, StageTimings &timings) {
+    // the throughputs are of the median run, over the input's uncompressed bytes
+    std::sort(timings.ns.begin(), timings.ns.end());
+    uint64_t median_ns = timings.ns[timings.ns.size() / 2];
+    double ns_per_byte = static_cast<double>(median_ns) / timings.num_bytes;
+    double mb_per_s = median_ns == 0 ? 0 : 1e3 * timings.num_bytes / median_ns;
+    out << timings.input_name << "," << timings.stage << "," << timings.num_bytes << ","
+        << timings.ns.size() << "," << timings.ns.front() << "," << median_ns << ","
+        << timings.ns.back() << "," << ns_per_byte << "," << mb_per_s << std::endl;
+}
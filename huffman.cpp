@@ -1,127 +1,593 @@
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <fstream>
+#include <sstream>
 #include <unordered_map>
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <set>
+#include <thread>
+#include <mutex>
 #include "TreeNode.h"
 #include "Bits.h"
+#include "BlockPlanner.h"
+#include "BoundedQueue.h"
+#include "CanonicalCode.h"
 #include "UncompressedReader.h"
 #include "CompressedWriter.h"
 #include "CompressedReader.h"
+#include "DecodeTable.h"
+#include "MappedFile.h"
+#include "Stats.h"
+#include "ThreadPool.h"
 
 #define COMPRESS 0
 #define DECOMPRESS 1
 #define TEST 2
+#define TRAIN 3
+#define ESTIMATE 4
 
-#define STDOUT_FILENAME "\0"
+#define STDIO_FILENAME "-"
+#define STATS_FORMAT_JSON "json"
 
-void parse_args(int argc, char **argv, int &mode, bool &verbose,
-    std::string &input_filename, std::string &output_filename);
+#define BLOCKS_IN_FLIGHT_PER_THREAD 2
+#define DEFAULT_READ_AHEAD 2
+#define BATCH_OUTPUT_BUFFER_SIZE (1 << 16)
+
+// This struct represents a dictionary loaded with --dict. Its bit sequences are used by every
+// block (de)compressed with it, so its tables are only made once.
+struct Dictionary {
+    uint32_t id;
+    huffman::EncodeTable encode_table;
+    std::shared_ptr<const huffman::DecodeTable> decode_table;
+};
+
+// This struct represents the options passed to huffman on the command line.
+struct Arguments {
+    int mode;
+    bool verbose = false;
+    int max_code_length = DEFAULT_MAX_CODE_LENGTH;
+    int num_threads = 1;
+    int read_ahead = DEFAULT_READ_AHEAD;    // the number of blocks read ahead of compression;
+                                            // 0 reads, compresses and writes on one thread
+    uint32_t sync_interval = 0;
+    bool interleaved = false;
+    bool context = false;           // whether blocks can be compressed with order-1 context tables
+    bool range = false;             // whether to decompress only range_length bytes from
+    uint64_t range_offset = 0;      // range_offset of the uncompressed file
+    uint64_t range_length = 0;
+    uint32_t sample_blocks = 0;     // with -e, the number of blocks spread over the input that
+                                    // the size is estimated from (0 for every block)
+    int checksum_type = CHECKSUM_CRC32C;
+    std::string dictionary_filename;
+    std::shared_ptr<const Dictionary> dictionary;   // loaded from dictionary_filename, if given
+    bool stats = false;
+    std::string stats_filename;     // where stats records are appended; stderr if empty
+    std::string batch_name;         // a directory, or a file listing one file per line, whose
+                                    // files are (de)compressed into out_dir; empty if not batch
+    std::string out_dir;
+    std::string input_filename;
+    std::string output_filename;
+};
+
+void parse_args(int argc, char **argv, Arguments &args);
+bool parse_range(const std::string &range_str, Arguments &args);
 void usage();
 
-void print_characters_information(
-    const std::unordered_map<unsigned char, int> &byte_to_frequency,
+void print_characters_information(std::ostream &out,
+    const huffman::ByteHistogram &byte_histogram,
     const std::unordered_map<unsigned char, std::unique_ptr<huffman::Bits>> &char_to_bits);
-void print_character_tree(const huffman::TreeNode &root);
-void print_compressed_data_info(const huffman::TreeFileRepr &tree_data,
+void print_character_tree(std::ostream &out, const huffman::TreeNode &root);
+void print_code_lengths(std::ostream &out, const huffman::CodeLengths &code_lengths);
+void print_compressed_data_info(std::ostream &out, const huffman::TreeFileRepr &tree_data,
     const huffman::CompressedFileRepr &file_data,
-    const std::string &compressed_file);
+    std::string_view compressed_file);
+void print_compressed_data_info(std::ostream &out,
+    const huffman::CodeLengthsFileRepr &code_lengths_data,
+    const huffman::CompressedFileRepr &file_data);
+void print_compressed_data_info(std::ostream &out, const uint32_t dictionary_id,
+    const huffman::CompressedFileRepr &file_data);
+void print_compressed_data_info(std::ostream &out,
+    const huffman::ContextMapFileRepr &context_map_data,
+    const std::vector<huffman::CodeLengthsFileRepr> &tables_data,
+    const huffman::CompressedFileRepr &file_data);
+void print_block_info(std::ostream &out, const huffman::BlockHeader &block_header);
+void print_length_limit_info(std::ostream &out,
+    const huffman::CodeLengths &unlimited_code_lengths,
+    const huffman::CodeLengths &code_lengths,
+    const huffman::ByteHistogram &byte_histogram, const int max_code_length);
+
+// This struct represents a block being decompressed. Its parts are decoded straight into
+// their places in output, possibly at the same time on different threads.
+struct DecompressingBlock {
+    std::string block_content;  // holds the block's content, unless the input file is mapped
+    huffman::ParsedBlock parsed;
+    std::string block_bytes;    // holds the decompressed block, unless the output file is mapped
+    char *output;               // where the decompressed block goes
+};
+
+// This struct represents a block of the input, read by compress_stream's reading stage.
+struct ReadBlock {
+    std::unique_ptr<std::string> buffer;    // holds the block, unless the input file is mapped
+    std::string_view bytes;
+};
+
+// This struct represents compressed bytes (along with their verbose info) being made for
+// compress_stream's writing stage.
+struct WritingBlock {
+    std::future<std::pair<std::string, std::string>> block_and_info;
+    std::unique_ptr<std::string> buffer;    // an input buffer that can be reused once the bytes
+                                            // are made, if any
+};
+
+std::istream *open_input(const std::string &filename, std::ifstream &file_input,
+    std::unique_ptr<huffman::MappedFile> &mapped_input);
+std::ostream *open_output(const std::string &filename, std::ofstream &file_output);
+std::unique_ptr<huffman::MappedFile> open_mapped_output(const std::string &filename,
+    const huffman::MappedFile *mapped_input);
+void remove_output(const std::string &filename, const std::string &input_filename);
+std::shared_ptr<const Dictionary> load_dictionary(const std::string &filename);
+void write_stats(const Arguments &args, const bool succeeded, const huffman::StreamStats &stats,
+    const std::chrono::steady_clock::time_point start_time);
+
+bool train_dictionary(std::istream &input, const huffman::MappedFile *mapped_input,
+    std::ostream &output, const Arguments &args, huffman::StreamStats &stats);
 
-std::string compress_file_content(const std::string &file_bytes, const bool verbose);
-std::string decompress_file_content(const std::string &file_bytes, const bool verbose);
-bool test_compression_decompression(const std::string &file_bytes, const bool verbose);
+bool run_batch(const Arguments &args, huffman::StreamStats &stats);
+bool list_batch_files(const std::string &batch_name, std::vector<std::string> &filenames);
+bool process_batch_file(const Arguments &file_args, huffman::StreamStats &stats);
+
+bool compress_stream(std::istream &input, const huffman::MappedFile *mapped_input,
+    std::ostream &output, const Arguments &args, huffman::StreamStats &stats);
+bool estimate_compressed_size(std::istream &input, const huffman::MappedFile *mapped_input,
+    const Arguments &args, huffman::StreamStats &stats);
+uint32_t get_stream_flags(const Arguments &args);
+std::string compress_block(std::string_view block_bytes, const huffman::BlockPiece &piece,
+    const Arguments &args, std::ostream &info_out);
+std::string compress_block_with_dictionary(std::string_view block_bytes, const Arguments &args,
+    std::ostream &info_out);
+std::string compress_block_with_contexts(std::string_view block_bytes,
+    const huffman::ContextPlan &plan, const Arguments &args, std::ostream &info_out);
+std::string compress_raw_block(std::string_view block_bytes, const bool as_runs,
+    const Arguments &args, std::ostream &info_out);
+huffman::CompressedFileRepr compress_block_bits(const huffman::EncodeTable &encode_table,
+    std::string_view block_bytes, const Arguments &args,
+    huffman::SyncPointsFileRepr &sync_points_data);
+bool decompress_stream(std::istream &input, const huffman::MappedFile *mapped_input,
+    std::ostream &output, huffman::MappedFile *mapped_output, const Arguments &args,
+    huffman::StreamStats &stats);
+bool decompress_range(std::istream &input, huffman::MappedFile *mapped_input,
+    std::ostream &output, const Arguments &args, huffman::StreamStats &stats);
+bool decompress_block(const huffman::BlockHeader &block_header, std::string_view block_content,
+    const uint32_t stream_flags, const Arguments &args, huffman::ThreadPool *pool,
+    char *mapped_block_output, const std::shared_ptr<DecompressingBlock> &block,
+    std::shared_ptr<const huffman::DecodeTable> &previous_decode_table,
+    std::vector<std::future<bool>> &segments_decompressed);
+bool decompress_file_content(std::string_view file_bytes, const bool verbose,
+    std::string &decompressed);
+bool decompress_v1_file_content(std::string_view file_bytes, const bool verbose,
+    std::string &decompressed);
+bool test_compression_decompression(std::istream &input, const huffman::MappedFile *mapped_input,
+    const Arguments &args, huffman::StreamStats &stats);
 
 int main(int argc, char **argv) {
-    int mode;
-    bool verbose;
-    std::string input_filename;
-    std::string output_filename;
-    parse_args(argc, argv, mode, verbose, input_filename, output_filename);
+    std::ios::sync_with_stdio(false);
+    // compress_stream can read stdin on one thread while writing stdout on another,
+    // so reading stdin mustn't flush stdout
+    std::cin.tie(nullptr);
 
-    std::string file_bytes;
-    if (!huffman::ReadFileContents(input_filename, file_bytes)) {
+    Arguments args;
+    parse_args(argc, argv, args);
+    auto start_time = std::chrono::steady_clock::now();
+    if (args.stats) {
+        huffman::EnablePhaseTimes();
+    }
+    if (!args.dictionary_filename.empty()) {
+        args.dictionary = load_dictionary(args.dictionary_filename);
+        if (!args.dictionary) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    huffman::StreamStats stats;
+    if (!args.batch_name.empty()) {
+        bool succeeded = run_batch(args, stats);
+        write_stats(args, succeeded, stats, start_time);
+        return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::ifstream file_input;
+    std::unique_ptr<huffman::MappedFile> mapped_input;
+    std::istream *input = open_input(args.input_filename, file_input, mapped_input);
+    if (input == nullptr) {
         return EXIT_FAILURE;
     }
 
-    std::string output_file_data;
-    if (mode == COMPRESS) {
-        output_file_data = compress_file_content(file_bytes, verbose);
-    } else if (mode == DECOMPRESS) {
-        output_file_data = decompress_file_content(file_bytes, verbose);
-    } else if (mode == TEST) {
-        return test_compression_decompression(file_bytes, verbose)
-            ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (args.mode == TEST || args.mode == ESTIMATE) {
+        bool succeeded = args.mode == TEST
+            ? test_compression_decompression(*input, mapped_input.get(), args, stats)
+            : estimate_compressed_size(*input, mapped_input.get(), args, stats);
+        write_stats(args, succeeded, stats, start_time);
+        return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // the output is truncated (or mapped at its final size) before the input is read through,
+    // so writing it over the input would destroy the input
+    std::error_code error;
+    if (args.input_filename.compare(STDIO_FILENAME) && args.output_filename.compare(STDIO_FILENAME)
+        && std::filesystem::equivalent(args.input_filename, args.output_filename, error)) {
+        std::cerr << "Can't write " << args.output_filename << " over itself!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::unique_ptr<huffman::MappedFile> mapped_output;
+    if (args.mode == DECOMPRESS && !args.range) {
+        mapped_output = open_mapped_output(args.output_filename, mapped_input.get());
+    }
+    std::ofstream file_output;
+    std::ostream *output = mapped_output
+        ? &mapped_output->GetStream()
+        : open_output(args.output_filename, file_output);
+    if (output == nullptr) {
+        return EXIT_FAILURE;
     }
 
-    if (output_filename.compare(STDOUT_FILENAME)) {
-        std::ofstream outstream(output_filename, std::ofstream::out | std::ofstream::binary);
-        outstream.write(output_file_data.data(), output_file_data.size());
-        outstream.close();
+    bool succeeded;
+    if (args.mode == COMPRESS) {
+        succeeded = compress_stream(*input, mapped_input.get(), *output, args, stats);
+    } else if (args.mode == DECOMPRESS && args.range) {
+        succeeded = decompress_range(*input, mapped_input.get(), *output, args, stats);
+    } else if (args.mode == DECOMPRESS) {
+        succeeded = decompress_stream(*input, mapped_input.get(), *output, mapped_output.get(),
+            args, stats);
     } else {
-        std::cout.write(output_file_data.data(), output_file_data.size());
+        succeeded = train_dictionary(*input, mapped_input.get(), *output, args, stats);
+    }
+    {
+        huffman::PhaseTimer timer(PHASE_WRITE);
+        output->flush();
     }
+    succeeded = succeeded && *output;
+    if (!succeeded) {
+        mapped_output.reset();
+        file_output.close();
+        remove_output(args.output_filename, args.input_filename);
+    }
+    write_stats(args, succeeded, stats, start_time);
 
-    return EXIT_SUCCESS;
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-void parse_args(int argc, char **argv, int &mode, bool &verbose,
-    std::string &input_filename, std::string &output_filename) {
-    if (argc != 3 && argc != 4 && argc != 5) {
+void parse_args(int argc, char **argv, Arguments &args) {
+    if (argc < 3) {
         usage();
     }
 
     std::string mode_str(argv[1]);
     if (!mode_str.compare("-c") || !mode_str.compare("-C")) {
-        mode = COMPRESS;
+        args.mode = COMPRESS;
     } else if (!mode_str.compare("-d") || !mode_str.compare("-D")) {
-        mode = DECOMPRESS;
+        args.mode = DECOMPRESS;
     } else if (!mode_str.compare("-t") || !mode_str.compare("-T")) {
-        mode = TEST;
+        args.mode = TEST;
+    } else if (!mode_str.compare("-r") || !mode_str.compare("-R")) {
+        args.mode = TRAIN;
+    } else if (!mode_str.compare("-e") || !mode_str.compare("-E")) {
+        args.mode = ESTIMATE;
     } else {
         usage();
     }
 
-    std::string verbose_str(argv[2]);
     int input_index = 2;
-    verbose = !verbose_str.compare("-v") || !verbose_str.compare("-V");
-    if (verbose) {
-        input_index++;
+    for (; input_index < argc && argv[input_index][0] == '-' && argv[input_index][1] != '\0';
+        input_index++) {
+        std::string option_str(argv[input_index]);
+        if (!option_str.compare("-v") || !option_str.compare("-V")) {
+            args.verbose = true;
+        } else if (!option_str.compare("--max-code-len") && input_index + 1 < argc) {
+            args.max_code_length = atoi(argv[++input_index]);
+            if (args.max_code_length < MIN_MAX_CODE_LENGTH
+                || args.max_code_length > CANONICAL_LENGTH_LIMIT) {
+                usage();
+            }
+        } else if (!option_str.compare("-j") && input_index + 1 < argc) {
+            args.num_threads = atoi(argv[++input_index]);
+            if (args.num_threads < 0) {
+                usage();
+            }
+        } else if (!option_str.compare("--read-ahead") && input_index + 1 < argc) {
+            args.read_ahead = atoi(argv[++input_index]);
+            if (args.read_ahead < 0) {
+                usage();
+            }
+        } else if (!option_str.compare("--sync-interval") && input_index + 1 < argc) {
+            int sync_interval = atoi(argv[++input_index]);
+            if (sync_interval != 0
+                && (sync_interval < MIN_SYNC_INTERVAL || sync_interval > MAX_BLOCK_SIZE)) {
+                usage();
+            }
+            args.sync_interval = sync_interval;
+        } else if (!option_str.compare("--interleaved")) {
+            args.interleaved = true;
+        } else if (!option_str.compare("--context")) {
+            args.context = true;
+        } else if (!option_str.compare("--range") && input_index + 1 < argc) {
+            if (!parse_range(argv[++input_index], args)) {
+                usage();
+            }
+        } else if (!option_str.compare("--sample") && input_index + 1 < argc) {
+            int sample_blocks = atoi(argv[++input_index]);
+            if (sample_blocks < 1) {
+                usage();
+            }
+            args.sample_blocks = sample_blocks;
+        } else if (!option_str.compare("--checksum") && input_index + 1 < argc) {
+            std::string checksum_str(argv[++input_index]);
+            if (!checksum_str.compare("simple")) {
+                args.checksum_type = CHECKSUM_SIMPLE;
+            } else if (!checksum_str.compare("crc32c")) {
+                args.checksum_type = CHECKSUM_CRC32C;
+            } else {
+                usage();
+            }
+        } else if (!option_str.compare("--dict") && input_index + 1 < argc) {
+            args.dictionary_filename = argv[++input_index];
+        } else if (!option_str.compare("--stats") && input_index + 1 < argc) {
+            if (std::string(argv[++input_index]).compare(STATS_FORMAT_JSON)) {
+                usage();
+            }
+            args.stats = true;
+        } else if (!option_str.compare("--stats-file") && input_index + 1 < argc) {
+            args.stats = true;
+            args.stats_filename = argv[++input_index];
+        } else if (!option_str.compare("--batch") && input_index + 1 < argc) {
+            args.batch_name = argv[++input_index];
+        } else if (!option_str.compare("--out-dir") && input_index + 1 < argc) {
+            args.out_dir = argv[++input_index];
+        } else {
+            usage();
+        }
     }
 
-    input_filename = argv[input_index];
-    output_filename = (input_index + 1 == argc) ? STDOUT_FILENAME : argv[input_index + 1];
+    // context blocks are one stream of bits, with their own tables
+    if ((args.interleaved && args.sync_interval != 0)
+        || (args.mode == TRAIN && !args.dictionary_filename.empty())
+        || (args.range && (args.mode != DECOMPRESS || !args.batch_name.empty()))
+        || (args.sample_blocks != 0 && args.mode != ESTIMATE)
+        || (args.context && (args.interleaved || args.sync_interval != 0
+            || !args.dictionary_filename.empty()))) {
+        usage();
+    }
+    // a batch names its files with --batch and --out-dir instead of infile and outfile,
+    // and its files' verbose output would be mixed together
+    if (!args.batch_name.empty()) {
+        if (input_index != argc || args.out_dir.empty() || args.verbose
+            || (args.mode != COMPRESS && args.mode != DECOMPRESS)) {
+            usage();
+        }
+        return;
+    }
+    if ((input_index != argc - 1 && input_index != argc - 2) || !args.out_dir.empty()) {
+        usage();
+    }
+    args.input_filename = argv[input_index];
+    args.output_filename = (input_index + 1 == argc) ? STDIO_FILENAME : argv[input_index + 1];
+}
+
+bool parse_range(const std::string &range_str, Arguments &args) {
+    size_t colon = range_str.find(':');
+    if (colon == 0 || colon == std::string::npos || colon + 1 == range_str.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < range_str.size(); i++) {
+        if (i != colon && !isdigit(static_cast<unsigned char>(range_str[i]))) {
+            return false;
+        }
+    }
+    args.range = true;
+    args.range_offset = strtoull(range_str.c_str(), nullptr, 10);
+    args.range_length = strtoull(range_str.c_str() + colon + 1, nullptr, 10);
+    return true;
 }
 
 void usage() {
-    std::cerr << "USAGE: huffman -<c|d|t> [-v] <infile> [outfile]" << std::endl
+    std::cerr << "USAGE: huffman -<c|d|t|r|e> [-v] [-j <n>] [--read-ahead <n>] [--max-code-len <n>]"
+        << std::endl
+        << "       [--sync-interval <n> | --interleaved | --context] [--checksum <simple|crc32c>]"
+        << std::endl
+        << "       [--dict <dictfile>] [--range <offset:length>] [--sample <n>] [--stats json]"
+        << std::endl
+        << "       [--stats-file <statsfile>] <infile> [outfile]" << std::endl
+        << "       huffman -<c|d> [options] --batch <listfile|dir> --out-dir <dir>" << std::endl
         << "    -c : compress infile, output to outfile (or stdout if not given)" << std::endl
         << "    -d : decompress infile, output to outfile (or stdout if not given)" << std::endl
+        << "         (infile or outfile can be - for stdin/stdout)" << std::endl
         << "    -t : compress infile then decompress the compressed contents, " << std::endl
         << "         to test if it matches with original file; outfile is ignored" << std::endl
-        << "    -v : verbose; print additional (de)compression information for debug" << std::endl;
+        << "    -r : train a dictionary on the sample data in infile, output to outfile"
+        << " (or stdout)" << std::endl
+        << "    -e : print the size that -c would compress infile to, and its ratio to infile's"
+        << " size," << std::endl
+        << "         without compressing it; outfile is ignored" << std::endl
+        << "    -v : verbose; print additional (de)compression information for debug" << std::endl
+        << "    --max-code-len <n> : limit bit sequences to n bits when compressing, where "
+        << MIN_MAX_CODE_LENGTH << " <= n <= " << CANONICAL_LENGTH_LIMIT
+        << " (default " << DEFAULT_MAX_CODE_LENGTH << ")" << std::endl
+        << "    -j <n> : (de)compress blocks on n threads (0 for one per hardware thread;"
+        << " default 1);" << std::endl
+        << "             the compressed file is the same for any n" << std::endl
+        << "    --read-ahead <n> : when compressing, read up to n blocks ahead of the blocks being"
+        << " compressed," << std::endl
+        << "             and write on another thread (default " << DEFAULT_READ_AHEAD
+        << "; 0 to read, compress and write in turn)" << std::endl
+        << "    --sync-interval <n> : when compressing, mark a sync point every n bytes of each"
+        << " block" << std::endl
+        << "             so that -d -j can split the block between threads; n is 0 (none, default)"
+        << std::endl
+        << "             or " << MIN_SYNC_INTERVAL << " <= n <= " << MAX_BLOCK_SIZE << std::endl
+        << "    --interleaved : when compressing, split each block into " << NUM_INTERLEAVED_STREAMS
+        << " streams" << std::endl
+        << "             that -d decodes side by side for speed on a single thread" << std::endl
+        << "    --context : when compressing, give each block up to " << MAX_CONTEXT_TABLES
+        << " tables of bit sequences, one for" << std::endl
+        << "             each group of bytes that are followed by alike bytes, and compress each"
+        << " byte with" << std::endl
+        << "             the table of the byte before it, where that is smaller" << std::endl
+        << "    --range <offset:length> : when decompressing, output only the length bytes from"
+        << " byte offset" << std::endl
+        << "             of the uncompressed file, decoding only the blocks (and, with"
+        << " --sync-interval," << std::endl
+        << "             the parts of blocks) that hold them" << std::endl
+        << "    --sample <n> : with -e, estimate the size from n blocks spread evenly over infile"
+        << std::endl
+        << "             (which must be a regular file), reading only their pages" << std::endl
+        << "    --checksum <simple|crc32c> : when compressing, the checksum that each block is"
+        << " verified" << std::endl
+        << "             with when decompressed (default crc32c)" << std::endl
+        << "    --dict <dictfile> : compress every block with the bit sequences of a dictionary"
+        << " made by -r," << std::endl
+        << "             instead of storing bit sequences in each block; a file compressed with"
+        << std::endl
+        << "             a dictionary needs the same --dict to be decompressed" << std::endl
+        << "    --stats json : write a JSON record of sizes, the time spent in each phase and"
+        << " peak memory" << std::endl
+        << "             to stderr when done" << std::endl
+        << "    --stats-file <statsfile> : same as --stats json, but append the record to"
+        << " statsfile instead" << std::endl
+        << "    --batch <listfile|dir> : (de)compress each file listed in listfile (one per line),"
+        << " or each file in dir," << std::endl
+        << "             into a file of the same name in the --out-dir directory; -j files are"
+        << " (de)compressed" << std::endl
+        << "             at a time, and -v can't be given" << std::endl;
     exit(EXIT_FAILURE);
 }
 
-void print_character_tree(const huffman::TreeNode &root) {
-    std::cout << "Character tree:" << std::endl
+std::istream *open_input(const std::string &filename, std::ifstream &file_input,
+    std::unique_ptr<huffman::MappedFile> &mapped_input) {
+    if (!filename.compare(STDIO_FILENAME)) {
+        return &std::cin;
+    }
+    // files that can't be mapped (e.g. pipes) are read through a stream instead
+    mapped_input = huffman::MappedFile::OpenForReading(filename);
+    if (mapped_input) {
+        return &mapped_input->GetStream();
+    }
+    file_input.open(filename, std::ifstream::in | std::ifstream::binary);
+    if (!file_input) {
+        std::cerr << "Invalid file" << std::endl;
+        return nullptr;
+    }
+    return &file_input;
+}
+
+std::ostream *open_output(const std::string &filename, std::ofstream &file_output) {
+    if (!filename.compare(STDIO_FILENAME)) {
+        return &std::cout;
+    }
+    file_output.open(filename, std::ofstream::out | std::ofstream::binary);
+    if (!file_output) {
+        std::cerr << "Invalid output file" << std::endl;
+        return nullptr;
+    }
+    return &file_output;
+}
+
+std::unique_ptr<huffman::MappedFile> open_mapped_output(const std::string &filename,
+    const huffman::MappedFile *mapped_input) {
+    // only a (version 3) file that is mapped whole can have its uncompressed size found up front
+    uint64_t uncompressed_size;
+    if (!filename.compare(STDIO_FILENAME) || mapped_input == nullptr
+        || !huffman::ScanUncompressedSize(mapped_input->GetBytes(), uncompressed_size)) {
+        return nullptr;
+    }
+    return huffman::MappedFile::CreateForWriting(filename, uncompressed_size);
+}
+
+void remove_output(const std::string &filename, const std::string &input_filename) {
+    // a failed run leaves no output file behind, rather than one holding part of the output
+    // (or, if it was created at its final size, zeros in place of the rest); only regular files
+    // are removed, so e.g. /dev/null is left alone, and never the input, whatever its name
+    std::error_code error;
+    if (filename.compare(STDIO_FILENAME) && std::filesystem::is_regular_file(filename, error)
+        && !std::filesystem::equivalent(filename, input_filename, error)) {
+        std::filesystem::remove(filename, error);
+    }
+}
+
+void write_stats(const Arguments &args, const bool succeeded, const huffman::StreamStats &stats,
+    const std::chrono::steady_clock::time_point start_time) {
+    if (!args.stats) {
+        return;
+    }
+    uint64_t wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_time).count();
+    const char *mode_names[] = { "compress", "decompress", "test", "train", "estimate" };
+    if (args.stats_filename.empty()) {
+        huffman::WriteStatsJson(std::cerr, mode_names[args.mode], succeeded, stats, wall_ns);
+        return;
+    }
+    std::ofstream stats_output(args.stats_filename, std::ofstream::out | std::ofstream::app);
+    if (!stats_output) {
+        std::cerr << "Invalid stats file" << std::endl;
+        return;
+    }
+    huffman::WriteStatsJson(stats_output, mode_names[args.mode], succeeded, stats, wall_ns);
+}
+
+std::shared_ptr<const Dictionary> load_dictionary(const std::string &filename) {
+    std::string dictionary_bytes;
+    if (!huffman::ReadFileContents(filename, dictionary_bytes)) {
+        return nullptr;
+    }
+    auto dictionary = std::make_shared<Dictionary>();
+    huffman::CodeLengthsFileRepr code_lengths_data;
+    huffman::CodeLengths code_lengths;
+    if (!huffman::PartitionDictionary(dictionary_bytes, dictionary->id, code_lengths_data)
+        || !huffman::CodeLengthsReprToCodeLengths(code_lengths_data, code_lengths)) {
+        return nullptr;
+    }
+    if (code_lengths_data.num_chars != NUM_CHARS) {
+        std::cerr << "The dictionary doesn't give every byte a bit sequence!" << std::endl;
+        return nullptr;
+    }
+    dictionary->encode_table = huffman::CanonicalEncodeTable(code_lengths);
+    dictionary->decode_table = std::make_shared<const huffman::DecodeTable>(code_lengths);
+    return dictionary;
+}
+
+void print_character_tree(std::ostream &out, const huffman::TreeNode &root) {
+    out << "Character tree:" << std::endl
         << huffman::TreeContentsRepr(root) << std::endl;
 }
 
-void print_characters_information(
-    const std::unordered_map<unsigned char, int> &byte_to_frequency,
+void print_code_lengths(std::ostream &out, const huffman::CodeLengths &code_lengths) {
+    out << "Character bit sequence lengths:" << std::endl;
+    for (const unsigned char c : huffman::CanonicalOrder(code_lengths)) {
+        out << "char: '" << c << "', length: " << (int) code_lengths[c] << std::endl;
+    }
+}
+
+void print_characters_information(std::ostream &out,
+    const huffman::ByteHistogram &byte_histogram,
     const std::unordered_map<unsigned char, std::unique_ptr<huffman::Bits>> &char_to_bits) {
-    std::cout << "Character information" << std::endl;
+    out << "Character information" << std::endl;
     for (const auto &kv : char_to_bits) {
-        std::cout << "char: '" << kv.first
+        out << "char: '" << kv.first
             << "', bits: " << *kv.second
-            << ", frequency: " << byte_to_frequency.at(kv.first) <<  std::endl;
+            << ", frequency: " << byte_histogram[kv.first] <<  std::endl;
     }
 }
 
-void print_compressed_data_info(const huffman::TreeFileRepr &tree_data,
+void print_compressed_data_info(std::ostream &out, const huffman::TreeFileRepr &tree_data,
     const huffman::CompressedFileRepr &file_data,
-    const std::string &compressed_file) {
-    std::cout << "Num tree nodes: " << tree_data.num_nodes << std::endl
+    std::string_view compressed_file) {
+    out << "Num tree nodes: " << tree_data.num_nodes << std::endl
         << "Special leaf location: " << tree_data.special_leaf_index << std::endl
         << "Tree data size (bytes): " << tree_data.tree_data.size() << std::endl
         << "All TreeFileRepr size (bytes): " << tree_data.ToBytes().size() << std::endl
@@ -131,71 +597,1147 @@ void print_compressed_data_info(const huffman::TreeFileRepr &tree_data,
         << "Total compressed file size: " << compressed_file.size() << std::endl;
 }
 
-std::string compress_file_content(const std::string &file_bytes, const bool verbose) {
-    if (file_bytes.empty()) {
-        if (verbose) {
+void print_compressed_data_info(std::ostream &out,
+    const huffman::CodeLengthsFileRepr &code_lengths_data,
+    const huffman::CompressedFileRepr &file_data) {
+    out << "Num chars with bit sequences: " << code_lengths_data.num_chars << std::endl
+        << "Max bit sequence length: " << (int) code_lengths_data.max_length << std::endl
+        << "All CodeLengthsFileRepr size (bytes): " << code_lengths_data.ToBytes().size()
+        << std::endl
+        << "Number of bits in compressed content: " << file_data.num_bits << std::endl
+        << "Compressed content size (bytes): " << file_data.compressed_bits.size() << std::endl
+        << "All CompressedFileRepr size (bytes): " << file_data.ToBytes().size() << std::endl;
+}
+
+void print_compressed_data_info(std::ostream &out, const uint32_t dictionary_id,
+    const huffman::CompressedFileRepr &file_data) {
+    out << "Dictionary ID: " << dictionary_id << std::endl
+        << "Number of bits in compressed content: " << file_data.num_bits << std::endl
+        << "Compressed content size (bytes): " << file_data.compressed_bits.size() << std::endl
+        << "All CompressedFileRepr size (bytes): " << file_data.ToBytes().size() << std::endl;
+}
+
+void print_compressed_data_info(std::ostream &out,
+    const huffman::ContextMapFileRepr &context_map_data,
+    const std::vector<huffman::CodeLengthsFileRepr> &tables_data,
+    const huffman::CompressedFileRepr &file_data) {
+    out << "Num context tables: " << (int) context_map_data.num_tables << std::endl;
+    for (size_t table = 0; table < tables_data.size(); table++) {
+        int num_contexts = std::count(context_map_data.context_tables.begin(),
+            context_map_data.context_tables.end(), table);
+        out << "Table " << table << ": " << num_contexts << " contexts, "
+            << tables_data[table].num_chars << " chars with bit sequences, max length "
+            << (int) tables_data[table].max_length << std::endl;
+    }
+    size_t tables_size = 0;
+    for (const huffman::CodeLengthsFileRepr &table_data : tables_data) {
+        tables_size += table_data.ToBytes().size();
+    }
+    out << "All ContextMapFileRepr and CodeLengthsFileRepr size (bytes): "
+        << context_map_data.ToBytes().size() + tables_size << std::endl
+        << "Number of bits in compressed content: " << file_data.num_bits << std::endl
+        << "Compressed content size (bytes): " << file_data.compressed_bits.size() << std::endl
+        << "All CompressedFileRepr size (bytes): " << file_data.ToBytes().size() << std::endl;
+}
+
+void print_block_info(std::ostream &out, const huffman::BlockHeader &block_header) {
+    out << "Block uncompressed size (bytes): " << block_header.uncompressed_length
+        << std::endl
+        << "Block content size (bytes): " << block_header.content_length << std::endl
+        << "All block size (bytes): "
+        << huffman::BlockHeader::MetadataSize() + block_header.content_length << std::endl;
+}
+
+void print_length_limit_info(std::ostream &out,
+    const huffman::CodeLengths &unlimited_code_lengths,
+    const huffman::CodeLengths &code_lengths,
+    const huffman::ByteHistogram &byte_histogram, const int max_code_length) {
+    uint64_t unlimited_num_bits
+        = huffman::CompressedNumBits(unlimited_code_lengths, byte_histogram);
+    uint64_t num_bits = huffman::CompressedNumBits(code_lengths, byte_histogram);
+    out << "Max bit sequence length without limit: "
+        << (int) *std::max_element(unlimited_code_lengths.begin(), unlimited_code_lengths.end())
+        << " (limit " << max_code_length << ")" << std::endl
+        << "Number of bits in compressed content without limit: " << unlimited_num_bits
+        << std::endl
+        << "Extra bits from limiting bit sequence lengths: " << num_bits - unlimited_num_bits
+        << " (" << 100.0 * (num_bits - unlimited_num_bits) / unlimited_num_bits << "%)"
+        << std::endl;
+}
+
+bool compress_stream(std::istream &input, const huffman::MappedFile *mapped_input,
+    std::ostream &output, const Arguments &args, huffman::StreamStats &stats) {
+    // the input is read, compressed and written in three stages, each on its own thread unless
+    // args.read_ahead is 0; the stages pass blocks through bounded queues, in file order
+    const bool pipelined = args.read_ahead > 0;
+
+    // input buffers whose blocks have been compressed, for later blocks to be read into
+    std::vector<std::unique_ptr<std::string>> free_buffers;
+    std::mutex free_buffers_mutex;
+
+    // when estimating from samples, only one in every sample_stride blocks of a mapped input
+    // is read, and the blocks in between are skipped as if they weren't there
+    const bool estimating = args.mode == ESTIMATE;
+    size_t sample_stride = 1;
+    if (estimating && args.sample_blocks != 0 && mapped_input != nullptr) {
+        size_t num_blocks = (mapped_input->GetSize() + DEFAULT_BLOCK_SIZE - 1) / DEFAULT_BLOCK_SIZE;
+        sample_stride = std::max<size_t>(
+            (num_blocks + args.sample_blocks - 1) / args.sample_blocks, 1);
+    }
+
+    // the reading stage: the blocks of a mapped input are viewed in place (though their pages are
+    // loaded ahead of time); otherwise each block is read into a buffer
+    size_t mapped_offset = 0;
+    auto read_block = [&](ReadBlock &block) {
+        huffman::PhaseTimer timer(PHASE_READ);
+        if (mapped_input != nullptr) {
+            block.bytes = mapped_input->GetBytes().substr(mapped_offset, DEFAULT_BLOCK_SIZE);
+            if (pipelined) {
+                mapped_input->LoadPages(mapped_offset, block.bytes.size());
+            }
+            mapped_offset = std::min<size_t>(mapped_offset + sample_stride * DEFAULT_BLOCK_SIZE,
+                mapped_input->GetSize());
+            return !block.bytes.empty();
+        }
+        {
+            std::lock_guard<std::mutex> lock(free_buffers_mutex);
+            if (!free_buffers.empty()) {
+                block.buffer = std::move(free_buffers.back());
+                free_buffers.pop_back();
+            }
+        }
+        if (!block.buffer) {
+            block.buffer = std::make_unique<std::string>();
+        }
+        if (!huffman::ReadFileBlock(input, DEFAULT_BLOCK_SIZE, *block.buffer)) {
+            return false;
+        }
+        block.bytes = *block.buffer;
+        return true;
+    };
+
+    // the writing stage: blocks are written in file order no matter which finishes first
+    uint64_t compressed_size = 0;
+    auto write_block = [&](WritingBlock &block) {
+        std::pair<std::string, std::string> block_and_info = block.block_and_info.get();
+        std::cout << block_and_info.second;
+        {
+            huffman::PhaseTimer timer(PHASE_WRITE);
+            output.write(block_and_info.first.data(), block_and_info.first.size());
+        }
+        compressed_size += block_and_info.first.size();
+        if (block.buffer) {
+            std::lock_guard<std::mutex> lock(free_buffers_mutex);
+            free_buffers.push_back(std::move(block.buffer));
+        }
+    };
+
+    std::unique_ptr<huffman::ThreadPool> pool;
+    if (args.num_threads != 1) {
+        pool = std::make_unique<huffman::ThreadPool>(args.num_threads);
+    }
+    const size_t max_blocks_in_flight = pool
+        ? BLOCKS_IN_FLIGHT_PER_THREAD * pool->GetNumThreads()
+        : std::max(args.read_ahead, 1);
+    huffman::BoundedQueue<ReadBlock> read_blocks(args.read_ahead);
+    huffman::BoundedQueue<WritingBlock> writing_blocks(max_blocks_in_flight);
+    std::deque<WritingBlock> blocks_in_flight;  // the writing stage's blocks, if not pipelined
+    std::thread reader;
+    std::thread writer;
+    if (pipelined) {
+        reader = std::thread([&]() {
+            ReadBlock block;
+            while (read_block(block)) {
+                read_blocks.Push(std::move(block));
+            }
+            read_blocks.Close();
+        });
+        writer = std::thread([&]() {
+            WritingBlock block;
+            while (writing_blocks.Pop(block)) {
+                write_block(block);
+            }
+        });
+    }
+    auto next_block = [&](ReadBlock &block) {
+        return pipelined ? read_blocks.Pop(block) : read_block(block);
+    };
+    auto queue_block = [&](WritingBlock block) {
+        if (pipelined) {
+            writing_blocks.Push(std::move(block));
+            return;
+        }
+        blocks_in_flight.push_back(std::move(block));
+        if (blocks_in_flight.size() >= max_blocks_in_flight) {
+            write_block(blocks_in_flight.front());
+            blocks_in_flight.pop_front();
+        }
+    };
+    // when estimating, blocks are only planned, and their planned sizes are added up instead of
+    // compressing and writing them
+    auto queue_bytes = [&](std::string bytes) {
+        if (estimating) {
+            compressed_size += bytes.size();
+            return;
+        }
+        std::promise<std::pair<std::string, std::string>> block_and_info;
+        block_and_info.set_value(std::make_pair(std::move(bytes), std::string()));
+        queue_block({ block_and_info.get_future(), nullptr });
+    };
+
+    // the compressing stage: blocks are compressed now, or on the pool; buffer (the input buffer
+    // of the last of a block's pieces) is reused once the writing stage is done with it, and
+    // block_size is the number of bytes that the block was planned to take up
+    auto add_block = [&](auto compress, std::unique_ptr<std::string> buffer,
+        const uint64_t block_size) {
+        if (estimating) {
+            compressed_size += block_size;
+            return;
+        }
+        auto compress_with_info = [compress]() {
+            std::stringstream info;
+            std::string block = compress(info);
+            return std::make_pair(std::move(block), info.str());
+        };
+        WritingBlock block;
+        block.buffer = std::move(buffer);
+        if (pool) {
+            block.block_and_info = pool->Submit(compress_with_info);
+        } else {
+            std::promise<std::pair<std::string, std::string>> block_and_info;
+            block_and_info.set_value(compress_with_info());
+            block.block_and_info = block_and_info.get_future();
+        }
+        queue_block(std::move(block));
+    };
+
+    huffman::CodeLengths previous_code_lengths;
+    bool has_previous_code_lengths = false;
+    bool is_empty = true;
+    ReadBlock read;
+    while (next_block(read)) {
+        std::string_view block_bytes = read.bytes;
+        if (is_empty) {
+            queue_bytes(huffman::BuildStreamHeader(DEFAULT_BLOCK_SIZE, get_stream_flags(args)));
+            is_empty = false;
+        }
+        stats.input_bytes += block_bytes.size();
+        stats.num_chars += block_bytes.size();
+
+        // a block whose bytes can't be compressed into fewer bytes than they take up is stored
+        // as it is, or as runs if it is mostly long runs of the same byte
+        huffman::ByteHistogram byte_histogram;
+        {
+            huffman::PhaseTimer timer(PHASE_HISTOGRAM);
+            byte_histogram = huffman::GetByteHistogram(block_bytes);
+        }
+        // no block of bit sequences can beat the entropy of the block's bytes, so runs are
+        // only counted up to that, and a block without enough redundancy to beat being raw
+        // isn't planned at all
+        uint64_t min_bits_size = huffman::MinBitsBlockSize(byte_histogram);
+        uint64_t raw_size = huffman::BlockHeader::MetadataSize() + block_bytes.size();
+        size_t runs_limit = std::min<uint64_t>(block_bytes.size() - 1,
+            min_bits_size - huffman::BlockHeader::MetadataSize());
+        size_t runs_size = huffman::EncodedRunsSize(block_bytes, runs_limit);
+        bool as_runs = runs_size <= runs_limit;
+        if (as_runs) {
+            raw_size = huffman::BlockHeader::MetadataSize() + runs_size;
+        }
+        auto add_raw_block = [&]() {
+            stats.num_bits += (as_runs ? runs_size : block_bytes.size()) * BITS_PER_ELEM;
+            stats.entropy_bits += huffman::EntropyBits(byte_histogram);
+            stats.has_entropy = true;
+            // a BLOCK_REPEAT block can't reuse bit sequences that a raw block doesn't have
+            has_previous_code_lengths = false;
+            add_block([block_bytes, as_runs, &args](std::ostream &info_out) {
+                return compress_raw_block(block_bytes, as_runs, args, info_out);
+            }, std::move(read.buffer), raw_size);
+        };
+        if (raw_size <= min_bits_size) {
+            add_raw_block();
+            continue;
+        }
+
+        if (args.dictionary) {
+            huffman::CodeLengths dictionary_code_lengths;
+            for (int c = 0; c < NUM_CHARS; c++) {
+                dictionary_code_lengths[c] = args.dictionary->encode_table[c].length;
+            }
+            uint64_t dictionary_size = huffman::BlockCompressedSize(dictionary_code_lengths,
+                byte_histogram, block_bytes.size(), true, get_stream_flags(args),
+                args.sync_interval) + sizeof(args.dictionary->id);
+            if (raw_size < dictionary_size) {
+                add_raw_block();
+                continue;
+            }
+
+            // the bytes of dictionary blocks are only counted if their stats are asked for
+            if (args.stats) {
+                stats.entropy_bits += huffman::EntropyBits(byte_histogram);
+                stats.has_entropy = true;
+                for (int c = 0; c < NUM_CHARS; c++) {
+                    stats.num_bits += byte_histogram[c] * args.dictionary->encode_table[c].length;
+                    stats.max_code_length = std::max(stats.max_code_length,
+                        args.dictionary->encode_table[c].length);
+                }
+            }
+            // the padding between interleaved streams is only counted for -e, once the block
+            // is chosen the same way as when compressing
+            if (estimating && args.interleaved) {
+                dictionary_size += huffman::InterleavedPaddingSize(dictionary_code_lengths,
+                    block_bytes);
+            }
+            add_block([block_bytes, &args](std::ostream &info_out) {
+                return compress_block_with_dictionary(block_bytes, args, info_out);
+            }, std::move(read.buffer), dictionary_size);
+            continue;
+        }
+
+        // a block's pieces depend on the code lengths of the block before it,
+        // so they are planned here, in file order, and only compressed on the pool
+        std::vector<huffman::BlockPiece> pieces = huffman::PlanBlockPieces(block_bytes,
+            has_previous_code_lengths ? &previous_code_lengths : nullptr, args.max_code_length,
+            get_stream_flags(args), args.sync_interval);
+        std::vector<uint64_t> piece_sizes;
+        uint64_t pieces_size = 0;
+        for (const huffman::BlockPiece &piece : pieces) {
+            piece_sizes.push_back(huffman::BlockCompressedSize(piece.code_lengths,
+                piece.byte_histogram, piece.num_chars, piece.reuses_code_lengths,
+                get_stream_flags(args), args.sync_interval));
+            pieces_size += piece_sizes.back();
+        }
+
+        // with --context, the block is compressed with order-1 context tables instead,
+        // if that takes up fewer bytes than its pieces (or than being raw)
+        if (args.context) {
+            std::vector<huffman::ByteHistogram> context_histograms
+                = huffman::GetContextHistograms(block_bytes);
+            huffman::ContextPlan plan = huffman::PlanContextTables(context_histograms,
+                args.max_code_length);
+            if (plan.compressed_size < pieces_size && plan.compressed_size < raw_size) {
+                for (size_t table = 0; table < plan.code_lengths.size(); table++) {
+                    stats.num_bits += huffman::CompressedNumBits(plan.code_lengths[table],
+                        plan.byte_histograms[table]);
+                    for (int c = 0; c < NUM_CHARS; c++) {
+                        stats.max_code_length = std::max<int>(stats.max_code_length,
+                            plan.code_lengths[table][c]);
+                    }
+                }
+                for (const huffman::ByteHistogram &byte_histogram : context_histograms) {
+                    stats.entropy_bits += huffman::EntropyBits(byte_histogram);
+                }
+                stats.has_entropy = true;
+
+                // a BLOCK_REPEAT block can't reuse a context block's tables
+                has_previous_code_lengths = false;
+                add_block([block_bytes, plan, &args](std::ostream &info_out) {
+                    return compress_block_with_contexts(block_bytes, plan, args, info_out);
+                }, std::move(read.buffer), plan.compressed_size);
+                continue;
+            }
+        }
+        if (raw_size < pieces_size) {
+            add_raw_block();
+            continue;
+        }
+        previous_code_lengths = pieces.back().code_lengths;
+        has_previous_code_lengths = true;
+        for (size_t i = 0; i < pieces.size(); i++) {
+            const huffman::BlockPiece &piece = pieces[i];
+            stats.num_bits += huffman::CompressedNumBits(piece.code_lengths, piece.byte_histogram);
+            stats.entropy_bits += huffman::EntropyBits(piece.byte_histogram);
+            stats.has_entropy = true;
+            for (int c = 0; c < NUM_CHARS; c++) {
+                stats.max_code_length = std::max<int>(stats.max_code_length,
+                    piece.code_lengths[c]);
+            }
+
+            std::string_view piece_bytes = block_bytes.substr(piece.first_char, piece.num_chars);
+            if (estimating && args.interleaved) {
+                piece_sizes[i] += huffman::InterleavedPaddingSize(piece.code_lengths, piece_bytes);
+            }
+            add_block([piece_bytes, piece, &args](std::ostream &info_out) {
+                return compress_block(piece_bytes, piece, args, info_out);
+            }, i + 1 == pieces.size() ? std::move(read.buffer) : nullptr, piece_sizes[i]);
+        }
+    }
+
+    // an empty file compresses to another empty file
+    if (!is_empty) {
+        queue_bytes(huffman::BuildEndBlock(get_stream_flags(args)));
+    }
+    if (pipelined) {
+        reader.join();
+        writing_blocks.Close();
+        writer.join();
+    }
+    while (!blocks_in_flight.empty()) {
+        write_block(blocks_in_flight.front());
+        blocks_in_flight.pop_front();
+    }
+    if (input.bad()) {
+        std::cerr << "Error reading the input file!" << std::endl;
+        return false;
+    }
+    stats.output_bytes = compressed_size;
+
+    if (args.verbose && !estimating) {
+        if (compressed_size == 0) {
             std::cout << "Compressing an empty file!" << std::endl;
         }
-        return "";
+        std::cout << "Total compressed file size: " << compressed_size << std::endl;
+    }
+    return true;
+}
+
+bool estimate_compressed_size(std::istream &input, const huffman::MappedFile *mapped_input,
+    const Arguments &args, huffman::StreamStats &stats) {
+    if (args.sample_blocks != 0 && mapped_input == nullptr) {
+        std::cerr << "Only a regular file can be sampled!" << std::endl;
+        return false;
+    }
+    // the blocks that aren't sampled are never read, so their pages needn't be read ahead
+    if (args.sample_blocks != 0) {
+        mapped_input->AdviseRandomAccess();
+    }
+    // the stats are of the planned compression, so they only count the sampled blocks
+    std::stringstream unused_output;
+    if (!compress_stream(input, mapped_input, unused_output, args, stats)) {
+        return false;
     }
 
-    // creating compressed representations
-    std::unordered_map<unsigned char, int> byte_to_frequency
-        = huffman::GetByteFrequencies(file_bytes);
-    std::unique_ptr<huffman::TreeNode> root = huffman::CreateTree(byte_to_frequency);
-    std::unordered_map<unsigned char, std::unique_ptr<huffman::Bits>> char_to_bits
-        = TreeCharToBits(*root);
+    // the sampled blocks' sizes are scaled up to the whole input; the stream header and end
+    // block are only counted once
+    uint64_t uncompressed_size = mapped_input ? mapped_input->GetSize() : stats.input_bytes;
+    uint64_t compressed_size = stats.output_bytes;
+    if (stats.input_bytes < uncompressed_size) {
+        uint64_t stream_size = huffman::BuildStreamHeader(DEFAULT_BLOCK_SIZE,
+            get_stream_flags(args)).size() + huffman::BuildEndBlock(get_stream_flags(args)).size();
+        compressed_size = stream_size + static_cast<uint64_t>(std::llround(
+            static_cast<double>(stats.output_bytes - stream_size) * uncompressed_size
+                / stats.input_bytes));
+    }
 
-    // making bytes for compressed file
-    huffman::TreeFileRepr tree_data = TreeToFileRepr(*root);
-    huffman::CompressedFileRepr file_data = CompressFileBytes(char_to_bits, file_bytes);
-    std::string compressed_file = BuildFile(tree_data, file_data);
+    std::cout << "Uncompressed size: " << uncompressed_size << " bytes" << std::endl;
+    if (stats.input_bytes < uncompressed_size) {
+        std::cout << "Estimated compressed size: " << compressed_size << " bytes (from "
+            << stats.input_bytes << " sampled bytes)" << std::endl;
+    } else {
+        std::cout << "Compressed size: " << compressed_size << " bytes" << std::endl;
+    }
+    if (uncompressed_size != 0) {
+        std::cout << "Compression ratio: "
+            << static_cast<double>(compressed_size) / uncompressed_size << std::endl;
+    }
+    return true;
+}
 
-    if (verbose) {
-        std::cout << "File compression info:" << std::endl;
-        print_character_tree(*root);
-        print_characters_information(byte_to_frequency, char_to_bits);
-        print_compressed_data_info(tree_data, file_data, compressed_file);
+uint32_t get_stream_flags(const Arguments &args) {
+    uint32_t stream_flags = 0;
+    if (args.sync_interval != 0) {
+        stream_flags |= FLAG_SYNC_POINTS;
+    }
+    if (args.interleaved) {
+        stream_flags |= FLAG_INTERLEAVED_STREAMS;
+    }
+    if (args.checksum_type == CHECKSUM_CRC32C) {
+        stream_flags |= FLAG_CRC32C;
+    }
+    return stream_flags;
+}
+
+std::string compress_block(std::string_view block_bytes, const huffman::BlockPiece &piece,
+    const Arguments &args, std::ostream &info_out) {
+    huffman::PhaseTimer timer(PHASE_ENCODE);
+    // creating compressed representations (the piece's code lengths were already chosen)
+    const huffman::CodeLengths &code_lengths = piece.code_lengths;
+    huffman::EncodeTable encode_table = huffman::CanonicalEncodeTable(code_lengths);
+
+    // making bytes for compressed block
+    huffman::CodeLengthsFileRepr code_lengths_data = huffman::CodeLengthsToFileRepr(code_lengths);
+    huffman::SyncPointsFileRepr sync_points_data;
+    huffman::CompressedFileRepr file_data = compress_block_bits(encode_table, block_bytes, args,
+        sync_points_data);
+    std::string block;
+    if (piece.reuses_code_lengths) {
+        block = args.sync_interval != 0
+            ? huffman::BuildRepeatBlock(file_data, sync_points_data, block_bytes.size(),
+                get_stream_flags(args))
+            : huffman::BuildRepeatBlock(file_data, block_bytes.size(), get_stream_flags(args));
+    } else {
+        block = args.sync_interval != 0
+            ? huffman::BuildBlock(code_lengths_data, file_data, sync_points_data,
+                block_bytes.size(), get_stream_flags(args))
+            : huffman::BuildBlock(code_lengths_data, file_data, block_bytes.size(),
+                get_stream_flags(args));
+    }
+
+    if (args.verbose) {
+        info_out << "Block compression info:" << std::endl;
+        // the tree is only made for printing; the lengths above don't need it
+        print_character_tree(info_out, *huffman::CreateTree(piece.byte_histogram));
+        print_characters_information(info_out, piece.byte_histogram,
+            huffman::CanonicalCharToBits(code_lengths));
+        if (piece.reuses_code_lengths) {
+            info_out << "Bit sequences reused from the previous block" << std::endl
+                << "Number of bits in compressed content: " << file_data.num_bits << std::endl;
+        } else {
+            print_compressed_data_info(info_out, code_lengths_data, file_data);
+        }
+        print_length_limit_info(info_out, huffman::HuffmanCodeLengths(piece.byte_histogram),
+            code_lengths, piece.byte_histogram, args.max_code_length);
+        info_out << "Block holds bytes " << piece.first_char << " to "
+            << piece.first_char + piece.num_chars << " of its read block" << std::endl;
+        if (args.sync_interval != 0) {
+            info_out << "Num sync points: " << sync_points_data.num_points << std::endl;
+        }
+        if (args.interleaved) {
+            info_out << "Num interleaved streams: " << NUM_INTERLEAVED_STREAMS << std::endl;
+        }
+        info_out << "All block size (bytes): " << block.size() << std::endl;
     }
 
-    return compressed_file;
+    return block;
 }
 
-std::string decompress_file_content(const std::string &file_bytes, const bool verbose) {
-    if (file_bytes.empty()) {
-        if (verbose) {
+std::string compress_block_with_dictionary(std::string_view block_bytes, const Arguments &args,
+    std::ostream &info_out) {
+    huffman::PhaseTimer timer(PHASE_ENCODE);
+    const Dictionary &dictionary = *args.dictionary;
+    huffman::SyncPointsFileRepr sync_points_data;
+    huffman::CompressedFileRepr file_data = compress_block_bits(dictionary.encode_table,
+        block_bytes, args, sync_points_data);
+    std::string block = args.sync_interval != 0
+        ? huffman::BuildBlock(dictionary.id, file_data, sync_points_data, block_bytes.size(),
+            get_stream_flags(args))
+        : huffman::BuildBlock(dictionary.id, file_data, block_bytes.size(),
+            get_stream_flags(args));
+
+    if (args.verbose) {
+        info_out << "Block compression info:" << std::endl;
+        print_compressed_data_info(info_out, dictionary.id, file_data);
+        if (args.sync_interval != 0) {
+            info_out << "Num sync points: " << sync_points_data.num_points << std::endl;
+        }
+        info_out << "All block size (bytes): " << block.size() << std::endl;
+    }
+
+    return block;
+}
+
+std::string compress_block_with_contexts(std::string_view block_bytes,
+    const huffman::ContextPlan &plan, const Arguments &args, std::ostream &info_out) {
+    huffman::PhaseTimer timer(PHASE_ENCODE);
+    std::vector<huffman::EncodeTable> encode_tables;
+    std::vector<huffman::CodeLengthsFileRepr> tables_data;
+    for (const huffman::CodeLengths &code_lengths : plan.code_lengths) {
+        encode_tables.push_back(huffman::CanonicalEncodeTable(code_lengths));
+        tables_data.push_back(huffman::CodeLengthsToFileRepr(code_lengths));
+    }
+    huffman::ContextMapFileRepr context_map_data = {
+        static_cast<uint8_t>(plan.code_lengths.size()),
+        plan.context_tables
+    };
+    huffman::CompressedFileRepr file_data = huffman::CompressFileBytesWithContexts(encode_tables,
+        plan.context_tables, block_bytes);
+    std::string block = huffman::BuildContextBlock(context_map_data, tables_data, file_data,
+        block_bytes.size(), get_stream_flags(args));
+
+    if (args.verbose) {
+        info_out << "Block compression info:" << std::endl;
+        print_compressed_data_info(info_out, context_map_data, tables_data, file_data);
+        info_out << "All block size (bytes): " << block.size() << std::endl;
+    }
+
+    return block;
+}
+
+std::string compress_raw_block(std::string_view block_bytes, const bool as_runs,
+    const Arguments &args, std::ostream &info_out) {
+    huffman::PhaseTimer timer(PHASE_ENCODE);
+    std::string block = as_runs
+        ? huffman::BuildRunsBlock(huffman::EncodeRuns(block_bytes), block_bytes.size(),
+            get_stream_flags(args))
+        : huffman::BuildStoredBlock(block_bytes, get_stream_flags(args));
+
+    if (args.verbose) {
+        info_out << "Block compression info:" << std::endl
+            << (as_runs ? "Block stored as runs of the same byte" : "Block stored as it is")
+            << std::endl
+            << "All block size (bytes): " << block.size() << std::endl;
+    }
+
+    return block;
+}
+
+huffman::CompressedFileRepr compress_block_bits(const huffman::EncodeTable &encode_table,
+    std::string_view block_bytes, const Arguments &args,
+    huffman::SyncPointsFileRepr &sync_points_data) {
+    return args.interleaved
+        ? huffman::CompressFileBytesInterleaved(encode_table, block_bytes)
+        : huffman::CompressFileBytes(encode_table, block_bytes, args.sync_interval,
+            sync_points_data);
+}
+
+bool train_dictionary(std::istream &input, const huffman::MappedFile *mapped_input,
+    std::ostream &output, const Arguments &args, huffman::StreamStats &stats) {
+    huffman::ByteHistogram byte_histogram = { };
+    if (mapped_input) {
+        byte_histogram = huffman::GetByteHistogram(mapped_input->GetBytes(), args.num_threads);
+    } else {
+        for (std::string chunk; huffman::ReadFileBlock(input, DEFAULT_BLOCK_SIZE, chunk);) {
+            huffman::ByteHistogram chunk_histogram = huffman::GetByteHistogram(chunk);
+            for (int c = 0; c < NUM_CHARS; c++) {
+                byte_histogram[c] += chunk_histogram[c];
+            }
+        }
+        if (input.bad()) {
+            std::cerr << "Error reading the input file!" << std::endl;
+            return false;
+        }
+    }
+
+    huffman::ByteHistogram sample_histogram = byte_histogram;
+    stats.entropy_bits = huffman::EntropyBits(sample_histogram);
+    stats.has_entropy = true;
+
+    // every byte gets a bit sequence, even if the sample doesn't have it,
+    // so that any file can be compressed with the dictionary
+    for (uint64_t &count : byte_histogram) {
+        count++;
+    }
+    huffman::CodeLengths code_lengths;
+    {
+        huffman::PhaseTimer timer(PHASE_TREE);
+        code_lengths = huffman::LimitCodeLengths(huffman::HuffmanCodeLengths(byte_histogram),
+            byte_histogram, args.max_code_length);
+    }
+    huffman::CodeLengthsFileRepr code_lengths_data = huffman::CodeLengthsToFileRepr(code_lengths);
+    std::string dictionary = huffman::BuildDictionary(code_lengths_data);
+    output.write(dictionary.data(), dictionary.size());
+
+    // the sample's stats are of compressing it with the dictionary
+    for (int c = 0; c < NUM_CHARS; c++) {
+        stats.num_chars += sample_histogram[c];
+        stats.max_code_length = std::max<int>(stats.max_code_length, code_lengths[c]);
+    }
+    stats.input_bytes = stats.num_chars;
+    stats.num_bits = huffman::CompressedNumBits(code_lengths, sample_histogram);
+    stats.output_bytes = dictionary.size();
+
+    if (args.verbose) {
+        std::cout << "Dictionary training info:" << std::endl;
+        print_code_lengths(std::cout, code_lengths);
+        std::cout << "Dictionary ID: " << huffman::ComputeDictionaryId(code_lengths_data)
+            << std::endl
+            << "All dictionary size (bytes): " << dictionary.size() << std::endl;
+    }
+    return true;
+}
+
+bool run_batch(const Arguments &args, huffman::StreamStats &stats) {
+    auto start_time = std::chrono::steady_clock::now();
+    std::vector<std::string> filenames;
+    if (!list_batch_files(args.batch_name, filenames)) {
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(args.out_dir, error);
+    if (error) {
+        std::cerr << "Could not create the output directory " << args.out_dir << "!" << std::endl;
+        return false;
+    }
+
+    // each file is (de)compressed on one thread (without reading ahead),
+    // into the file of the same name in out_dir
+    std::vector<Arguments> files_args;
+    std::set<std::string> output_filenames;
+    for (const std::string &filename : filenames) {
+        Arguments file_args = args;
+        file_args.num_threads = 1;
+        file_args.read_ahead = 0;
+        file_args.input_filename = filename;
+        file_args.output_filename = (std::filesystem::path(args.out_dir)
+            / std::filesystem::path(filename).filename()).string();
+        if (!output_filenames.insert(file_args.output_filename).second) {
+            std::cerr << "More than one file in the batch is named "
+                << std::filesystem::path(filename).filename() << "!" << std::endl;
+            return false;
+        }
+        files_args.push_back(std::move(file_args));
+    }
+
+    std::unique_ptr<huffman::ThreadPool> pool;
+    if (args.num_threads != 1) {
+        pool = std::make_unique<huffman::ThreadPool>(args.num_threads);
+    }
+    std::vector<huffman::StreamStats> files_stats(files_args.size());
+    std::vector<std::future<bool>> files_processed;
+    size_t num_failed = 0;
+    for (size_t i = 0; i < files_args.size(); i++) {
+        if (pool) {
+            files_processed.push_back(pool->Submit([&files_args, &files_stats, i]() {
+                return process_batch_file(files_args[i], files_stats[i]);
+            }));
+        } else if (!process_batch_file(files_args[i], files_stats[i])) {
+            num_failed++;
+        }
+    }
+    for (std::future<bool> &file_processed : files_processed) {
+        if (!file_processed.get()) {
+            num_failed++;
+        }
+    }
+    for (const huffman::StreamStats &file_stats : files_stats) {
+        huffman::AddStreamStats(stats, file_stats);
+    }
+
+    // throughput is of the uncompressed bytes, whichever way they were processed
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start_time).count();
+    std::cout << "Batch: " << files_args.size() << " files (" << num_failed << " failed), "
+        << stats.input_bytes << " bytes in, " << stats.output_bytes << " bytes out, "
+        << seconds << " s, " << stats.num_chars / seconds / 1e6 << " MB/s" << std::endl;
+    return num_failed == 0;
+}
+
+bool list_batch_files(const std::string &batch_name, std::vector<std::string> &filenames) {
+    std::error_code error;
+    if (std::filesystem::is_directory(batch_name, error)) {
+        for (const auto &entry : std::filesystem::directory_iterator(batch_name, error)) {
+            if (entry.is_regular_file()) {
+                filenames.push_back(entry.path().string());
+            }
+        }
+        if (error) {
+            std::cerr << "Could not list the files in " << batch_name << "!" << std::endl;
+            return false;
+        }
+        std::sort(filenames.begin(), filenames.end());
+        return true;
+    }
+
+    std::ifstream list(batch_name);
+    if (!list) {
+        std::cerr << "Invalid batch file list" << std::endl;
+        return false;
+    }
+    for (std::string line; std::getline(list, line);) {
+        if (!line.empty()) {
+            filenames.push_back(line);
+        }
+    }
+    return !list.bad();
+}
+
+bool process_batch_file(const Arguments &file_args, huffman::StreamStats &stats) {
+    // each thread reuses its buffers for every file it (de)compresses
+    thread_local std::string input_buffer;
+    thread_local std::vector<char> output_buffer(BATCH_OUTPUT_BUFFER_SIZE);
+
+    std::unique_ptr<huffman::MappedFile> input;
+    {
+        huffman::PhaseTimer timer(PHASE_READ);
+        input = huffman::MappedFile::ReadIntoBuffer(file_args.input_filename, input_buffer);
+    }
+    if (!input) {
+        std::cerr << "Could not read " << file_args.input_filename << "!" << std::endl;
+        return false;
+    }
+    std::error_code error;
+    if (std::filesystem::equivalent(file_args.input_filename, file_args.output_filename, error)) {
+        std::cerr << "Can't write " << file_args.output_filename << " over itself!" << std::endl;
+        return false;
+    }
+    std::ofstream output;
+    output.rdbuf()->pubsetbuf(output_buffer.data(), output_buffer.size());
+    output.open(file_args.output_filename, std::ofstream::out | std::ofstream::binary);
+    if (!output) {
+        std::cerr << "Invalid output file " << file_args.output_filename << std::endl;
+        return false;
+    }
+
+    bool succeeded = file_args.mode == COMPRESS
+        ? compress_stream(input->GetStream(), input.get(), output, file_args, stats)
+        : decompress_stream(input->GetStream(), input.get(), output, nullptr, file_args, stats);
+    {
+        huffman::PhaseTimer timer(PHASE_WRITE);
+        output.close();
+    }
+    if (!succeeded || !output) {
+        remove_output(file_args.output_filename, file_args.input_filename);
+        std::cerr << "Could not " << (file_args.mode == COMPRESS ? "compress " : "decompress ")
+            << file_args.input_filename << "!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool decompress_stream(std::istream &input, const huffman::MappedFile *mapped_input,
+    std::ostream &output, huffman::MappedFile *mapped_output, const Arguments &args,
+    huffman::StreamStats &stats) {
+    std::string magic_bytes;
+    if (!huffman::ReadFileBlock(input, sizeof(uint32_t), magic_bytes)) {
+        if (args.verbose) {
             std::cout << "Decompressing an empty file!" << std::endl;
         }
-        return "";
+        return !input.bad();
+    }
+
+    uint32_t magic_number = huffman::GetMagicNumber(magic_bytes);
+    if (magic_number == MAGIC_NUMBER_V1 || magic_number == MAGIC_NUMBER_V2) {
+        // files from before blocks were added are decompressed all at once
+        std::string file_bytes;
+        if (!mapped_input) {
+            file_bytes = magic_bytes;
+            for (std::string chunk; huffman::ReadFileBlock(input, DEFAULT_BLOCK_SIZE, chunk);) {
+                file_bytes += chunk;
+            }
+        }
+        std::string_view compressed = mapped_input ? mapped_input->GetBytes() : file_bytes;
+        std::string decompressed;
+        if (!decompress_file_content(compressed, args.verbose, decompressed)) {
+            return false;
+        }
+        huffman::PhaseTimer timer(PHASE_WRITE);
+        output.write(decompressed.data(), decompressed.size());
+        stats.input_bytes = compressed.size();
+        stats.output_bytes = decompressed.size();
+        stats.num_chars = decompressed.size();
+        return true;
+    } else if (magic_number != MAGIC_NUMBER_V3) {
+        std::cerr << "The file's magic number doesn't match what's expected!" << std::endl;
+        return false;
     }
 
+    huffman::StreamHeader stream_header;
+    stream_header.magic_number = magic_number;
+    if (!huffman::ReadStreamHeader(input, stream_header)) {
+        return false;
+    }
+
+    std::unique_ptr<huffman::ThreadPool> pool;
+    if (args.num_threads != 1) {
+        pool = std::make_unique<huffman::ThreadPool>(args.num_threads);
+    }
+
+    // blocks being decompressed by the pool, in file order, along with whether each of their
+    // segments decompressed; blocks are written in this order no matter which finishes first
+    std::deque<std::pair<std::shared_ptr<DecompressingBlock>, std::vector<std::future<bool>>>>
+        blocks_in_flight;
+    auto write_oldest_block = [&]() {
+        bool decompressed = true;
+        for (std::future<bool> &segment_decompressed : blocks_in_flight.front().second) {
+            decompressed = segment_decompressed.get() && decompressed;
+        }
+        const std::string &block_bytes = blocks_in_flight.front().first->block_bytes;
+        if (decompressed && !mapped_output) {
+            huffman::PhaseTimer timer(PHASE_WRITE);
+            output.write(block_bytes.data(), block_bytes.size());
+        }
+        blocks_in_flight.pop_front();
+        return decompressed;
+    };
+
+    // the blocks of a mapped input are parsed in place; otherwise each block's content is read
+    // into a buffer that is kept until the block is decompressed
+    std::string_view mapped_blocks;
+    if (mapped_input) {
+        mapped_blocks = mapped_input->GetBytes().substr(huffman::StreamHeader::MetadataSize());
+    }
+    std::shared_ptr<DecompressingBlock> block;
+    huffman::BlockHeader block_header;
+    std::string_view block_content;
+    auto read_block = [&]() {
+        huffman::PhaseTimer timer(PHASE_READ);
+        block = std::make_shared<DecompressingBlock>();
+        if (mapped_input) {
+            if (!huffman::ReadBlock(mapped_blocks, stream_header, block_header, block_content)) {
+                return false;
+            }
+        } else if (!huffman::ReadBlock(input, stream_header, block_header,
+            block->block_content)) {
+            return false;
+        } else {
+            block_content = block->block_content;
+        }
+        stats.input_bytes += huffman::BlockHeader::MetadataSize() + block_content.size();
+        return true;
+    };
+
+    uint64_t uncompressed_size = 0;
+    uint64_t num_blocks = 0;
+    std::shared_ptr<const huffman::DecodeTable> previous_decode_table;
+    stats.input_bytes = huffman::StreamHeader::MetadataSize();
+    while (read_block()) {
+        num_blocks++;
+        if (block_header.block_type == BLOCK_END) {
+            while (!blocks_in_flight.empty()) {
+                if (!write_oldest_block()) {
+                    return false;
+                }
+            }
+            stats.output_bytes = uncompressed_size;
+            stats.num_chars = uncompressed_size;
+            return !mapped_output || uncompressed_size == mapped_output->GetSize();
+        }
+
+        // a mapped output file was sized to fit every block, so blocks are decompressed into it
+        char *mapped_block_output = nullptr;
+        if (mapped_output) {
+            if (mapped_output->GetSize() - uncompressed_size < block_header.uncompressed_length) {
+                std::cerr << "The file changed while it was being decompressed!" << std::endl;
+                return false;
+            }
+            mapped_block_output = mapped_output->GetData() + uncompressed_size;
+        }
+        uncompressed_size += block_header.uncompressed_length;
+
+        std::vector<std::future<bool>> segments_decompressed;
+        if (!decompress_block(block_header, block_content, stream_header.flags, args,
+            pool.get(), mapped_block_output, block, previous_decode_table,
+            segments_decompressed)) {
+            return false;
+        }
+        stats.num_bits += block->parsed.file_data.num_bits;
+
+        if (!pool) {
+            if (!mapped_output) {
+                huffman::PhaseTimer timer(PHASE_WRITE);
+                output.write(block->block_bytes.data(), block->block_bytes.size());
+            }
+            continue;
+        }
+        blocks_in_flight.emplace_back(std::move(block), std::move(segments_decompressed));
+        if (blocks_in_flight.size()
+            >= static_cast<size_t>(BLOCKS_IN_FLIGHT_PER_THREAD * pool->GetNumThreads())
+            && !write_oldest_block()) {
+            return false;
+        }
+    }
+    // each block has its own checksum, so only the blocks from this one on are lost
+    std::cerr << "Could not read block " << num_blocks + 1 << " of the file!" << std::endl;
+    return false;
+}
+
+bool decompress_block(const huffman::BlockHeader &block_header, std::string_view block_content,
+    const uint32_t stream_flags, const Arguments &args, huffman::ThreadPool *pool,
+    char *mapped_block_output, const std::shared_ptr<DecompressingBlock> &block,
+    std::shared_ptr<const huffman::DecodeTable> &previous_decode_table,
+    std::vector<std::future<bool>> &segments_decompressed) {
+    const huffman::ParsedBlock &parsed = block->parsed;
+    {
+        huffman::PhaseTimer timer(PHASE_TREE);
+        if (!huffman::ParseBlock(stream_flags, block_header, block_content,
+            args.dictionary ? args.dictionary->id : 0,
+            args.dictionary ? args.dictionary->decode_table : nullptr, previous_decode_table,
+            block->parsed)) {
+            return false;
+        }
+    }
+
+    if (args.verbose) {
+        std::cout << "Block decompression info:" << std::endl;
+        if (block_header.block_type == BLOCK_STORED) {
+            std::cout << "Block stored as it is" << std::endl;
+        } else if (block_header.block_type == BLOCK_RUNS) {
+            std::cout << "Block stored as runs of the same byte" << std::endl;
+        } else if (block_header.block_type == BLOCK_CONTEXT) {
+            print_compressed_data_info(std::cout, parsed.context_map_data, parsed.tables_data,
+                parsed.file_data);
+        } else if (block_header.block_type == BLOCK_DICTIONARY) {
+            print_compressed_data_info(std::cout, parsed.dictionary_id, parsed.file_data);
+        } else if (block_header.block_type == BLOCK_REPEAT) {
+            std::cout << "Bit sequences reused from the previous block" << std::endl
+                << "Number of bits in compressed content: " << parsed.file_data.num_bits
+                << std::endl;
+        } else {
+            print_code_lengths(std::cout, parsed.code_lengths);
+            print_compressed_data_info(std::cout, parsed.code_lengths_data, parsed.file_data);
+        }
+        if (parsed.decode_table && (stream_flags & FLAG_SYNC_POINTS)) {
+            std::cout << "Num sync points: " << parsed.sync_points_data.num_points << std::endl;
+        }
+        if (parsed.decode_table && parsed.interleaved) {
+            std::cout << "Num interleaved streams: " << parsed.segments.size() << std::endl;
+        }
+        print_block_info(std::cout, block_header);
+    }
+
+    // every part is decoded into its final place, so they can be decoded in any order
+    if (mapped_block_output != nullptr) {
+        block->output = mapped_block_output;
+    } else {
+        block->block_bytes.resize(block_header.uncompressed_length);
+        block->output = &block->block_bytes[0];
+    }
+    for (size_t part = 0; part < huffman::NumBlockParts(parsed); part++) {
+        auto decompress_part = [block, part]() {
+            huffman::PhaseTimer timer(PHASE_DECODE);
+            return huffman::DecodeBlockPart(block->parsed, part, block->output);
+        };
+        if (pool) {
+            segments_decompressed.push_back(pool->Submit(decompress_part));
+        } else if (!decompress_part()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool decompress_range(std::istream &input, huffman::MappedFile *mapped_input,
+    std::ostream &output, const Arguments &args, huffman::StreamStats &stats) {
+    // a mapped file's blocks are read in place, so only the pages that the range needs are read
+    // from the disk; other inputs can't be skipped through, so they are read whole
+    std::string file_bytes;
+    if (mapped_input) {
+        mapped_input->AdviseRandomAccess();
+    } else {
+        huffman::PhaseTimer timer(PHASE_READ);
+        for (std::string chunk; huffman::ReadFileBlock(input, DEFAULT_BLOCK_SIZE, chunk);) {
+            file_bytes += chunk;
+        }
+        if (input.bad()) {
+            std::cerr << "Error reading the input file!" << std::endl;
+            return false;
+        }
+    }
+    std::string_view compressed = mapped_input ? mapped_input->GetBytes() : file_bytes;
+    stats.input_bytes = compressed.size();
+
+    std::string range_bytes(args.range_length, '\0');
+    uint32_t magic_number = huffman::GetMagicNumber(compressed);
+    if (magic_number == MAGIC_NUMBER_V1 || magic_number == MAGIC_NUMBER_V2) {
+        // files from before blocks were added are decompressed all at once
+        std::string decompressed;
+        if (!decompress_file_content(compressed, args.verbose, decompressed)) {
+            return false;
+        }
+        if (args.range_offset > decompressed.size()
+            || args.range_length > decompressed.size() - args.range_offset) {
+            std::cerr << "The range goes past the end of the file!" << std::endl;
+            return false;
+        }
+        range_bytes = decompressed.substr(args.range_offset, args.range_length);
+    } else {
+        huffman::PhaseTimer timer(PHASE_DECODE);
+        if (!huffman::DecompressRange(compressed, args.range_offset, args.range_length,
+            args.dictionary ? args.dictionary->id : 0,
+            args.dictionary ? args.dictionary->decode_table.get() : nullptr, &range_bytes[0])) {
+            return false;
+        }
+    }
+
+    if (args.verbose) {
+        std::cout << "Decompressed bytes " << args.range_offset << " to "
+            << args.range_offset + args.range_length << " of the uncompressed file" << std::endl;
+    }
+    huffman::PhaseTimer timer(PHASE_WRITE);
+    output.write(range_bytes.data(), range_bytes.size());
+    stats.output_bytes = range_bytes.size();
+    stats.num_chars = range_bytes.size();
+    return true;
+}
+
+bool decompress_file_content(std::string_view file_bytes, const bool verbose,
+    std::string &decompressed) {
+    if (huffman::GetMagicNumber(file_bytes) == MAGIC_NUMBER_V1) {
+        return decompress_v1_file_content(file_bytes, verbose, decompressed);
+    }
+
+    // separate compressed file into respective sections
+    huffman::CodeLengthsFileRepr code_lengths_data;
+    huffman::CompressedFileRepr file_data;
+    if (!PartitionFileContents(file_bytes, code_lengths_data, file_data)) {
+        return false;
+    }
+
+    huffman::CodeLengths code_lengths;
+    if (!huffman::CodeLengthsReprToCodeLengths(code_lengths_data, code_lengths)) {
+        return false;
+    }
+
+    if (verbose) {
+        std::cout << "File decompression info:" << std::endl;
+        print_code_lengths(std::cout, code_lengths);
+        print_compressed_data_info(std::cout, code_lengths_data, file_data);
+        std::cout << "Total compressed file size: " << file_bytes.size() << std::endl;
+    }
+
+    decompressed = huffman::DecompressFile(code_lengths, file_data);
+    return true;
+}
+
+bool decompress_v1_file_content(std::string_view file_bytes, const bool verbose,
+    std::string &decompressed) {
     // separate compressed file into respective sections
     huffman::TreeFileRepr tree_data;
     huffman::CompressedFileRepr file_data;
     if (!PartitionFileContents(file_bytes, tree_data, file_data)) {
-        exit(EXIT_FAILURE);
+        return false;
     }
 
     std::unique_ptr<huffman::TreeNode> root = TreeReprToTree(tree_data);
 
     if (verbose) {
         std::cout << "File decompression info:" << std::endl;
-        print_character_tree(*root);
-        print_compressed_data_info(tree_data, file_data, file_bytes);
+        print_character_tree(std::cout, *root);
+        print_compressed_data_info(std::cout, tree_data, file_data, file_bytes);
     }
 
-    return DecompressFile(*root, file_data);
+    decompressed = DecompressFile(*root, file_data);
+    return true;
 }
 
-bool test_compression_decompression(const std::string &file_bytes, const bool verbose) {
-    std::string compressed_file_data = compress_file_content(file_bytes, verbose);
-    std::string decompressed_file_data = decompress_file_content(compressed_file_data, verbose);
-    if (!file_bytes.compare(decompressed_file_data)) {
+bool test_compression_decompression(std::istream &input, const huffman::MappedFile *mapped_input,
+    const Arguments &args, huffman::StreamStats &stats) {
+    // a mapped input is compressed in place; other inputs are read into a buffer first
+    std::string file_buffer;
+    std::unique_ptr<huffman::MappedFile> buffered_input;
+    if (!mapped_input) {
+        for (std::string chunk; huffman::ReadFileBlock(input, DEFAULT_BLOCK_SIZE, chunk);) {
+            file_buffer += chunk;
+        }
+        buffered_input = huffman::MappedFile::ViewBuffer(file_buffer);
+        mapped_input = buffered_input.get();
+    }
+    std::istream &file_input = buffered_input ? buffered_input->GetStream() : input;
+
+    // the stats are of the compression; the decompression only adds to the phases' times
+    std::stringstream compressed_file_data;
+    if (!compress_stream(file_input, mapped_input, compressed_file_data, args, stats)) {
+        std::cerr << "Test failed! Could not compress the file!" << std::endl;
+        return false;
+    }
+
+    // the compressed file is decompressed the way a mapped file is, straight into a buffer
+    // sized once from its blocks' headers
+    std::string compressed_bytes = compressed_file_data.str();
+    uint64_t uncompressed_size = 0;
+    if (!compressed_bytes.empty()
+        && !huffman::ScanUncompressedSize(compressed_bytes, uncompressed_size)) {
+        std::cerr << "Test failed! Could not compress then decompress the file!" << std::endl;
+        return false;
+    }
+    std::string decompressed_bytes(uncompressed_size, '\0');
+    std::unique_ptr<huffman::MappedFile> compressed_input
+        = huffman::MappedFile::ViewBuffer(compressed_bytes);
+    std::unique_ptr<huffman::MappedFile> decompressed_output
+        = huffman::MappedFile::ViewBuffer(decompressed_bytes);
+    huffman::StreamStats decompression_stats;
+    if (!decompress_stream(compressed_input->GetStream(), compressed_input.get(),
+        decompressed_output->GetStream(), decompressed_output.get(), args,
+        decompression_stats)) {
+        std::cerr << "Test failed! Could not compress then decompress the file!" << std::endl;
+        return false;
+    }
+
+    if (mapped_input->GetBytes() == decompressed_bytes) {
         std::cout << "Test passed! Compressed-then-decompressed file is the same!" << std::endl;
         return true;
     } else {
         std::cerr << "Test failed! Compressed-then-decompressed file is not the same!"
-            << std::endl << decompressed_file_data << std::endl;
+            << std::endl << decompressed_bytes << std::endl;
         return false;
     }
 }